@@ -0,0 +1,666 @@
+#include "argparse/argparse.hpp"
+#include "bus.hpp"
+#include "cache_controller.hpp"
+#include "memory_controller.hpp"
+#include "simulation.hpp"
+#include "statistics.hpp"
+#include "trace.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <new>
+#include <numeric>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace {
+// Heap allocations made by the whole process, counted by the replaced global
+// operator new below
+std::atomic<uint64_t> num_allocations{0};
+
+auto counted_malloc(size_t size) -> void * {
+  num_allocations.fetch_add(1, std::memory_order_relaxed);
+  if (auto ptr = std::malloc(size == 0 ? 1 : size)) {
+    return ptr;
+  }
+  throw std::bad_alloc{};
+}
+
+auto counted_aligned_alloc(size_t size, std::align_val_t alignment)
+    -> void * {
+  num_allocations.fetch_add(1, std::memory_order_relaxed);
+  // aligned_alloc() needs a size that is a multiple of the alignment
+  const auto align = static_cast<size_t>(alignment);
+  const auto rounded = (std::max<size_t>(size, 1) + align - 1) / align * align;
+  if (auto ptr = std::aligned_alloc(align, rounded)) {
+    return ptr;
+  }
+  throw std::bad_alloc{};
+}
+} // namespace
+
+// Every replaced form frees with free(), but GCC only sees that the pointer
+// came from a (replaced) operator new and warns on each inlined delete
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+
+auto operator new(size_t size) -> void * { return counted_malloc(size); }
+auto operator new[](size_t size) -> void * { return counted_malloc(size); }
+auto operator new(size_t size, std::align_val_t alignment) -> void * {
+  return counted_aligned_alloc(size, alignment);
+}
+auto operator new[](size_t size, std::align_val_t alignment) -> void * {
+  return counted_aligned_alloc(size, alignment);
+}
+
+void operator delete(void *ptr) noexcept { std::free(ptr); }
+void operator delete[](void *ptr) noexcept { std::free(ptr); }
+void operator delete(void *ptr, size_t) noexcept { std::free(ptr); }
+void operator delete[](void *ptr, size_t) noexcept { std::free(ptr); }
+void operator delete(void *ptr, std::align_val_t) noexcept { std::free(ptr); }
+void operator delete[](void *ptr, std::align_val_t) noexcept {
+  std::free(ptr);
+}
+void operator delete(void *ptr, size_t, std::align_val_t) noexcept {
+  std::free(ptr);
+}
+void operator delete[](void *ptr, size_t, std::align_val_t) noexcept {
+  std::free(ptr);
+}
+
+#pragma GCC diagnostic pop
+
+namespace {
+constexpr auto NUM_REPETITIONS = 5;
+constexpr auto NUM_SIMULATION_REPETITIONS = 3;
+constexpr auto BENCH_CACHE_SIZE = 4096;
+constexpr auto BENCH_ASSOCIATIVITY = 2;
+constexpr auto BENCH_BLOCK_SIZE = 32;
+
+struct BenchResult {
+  std::string name;
+  uint64_t num_ops;
+  double ns_per_op;
+  std::optional<double> cycles_per_second;
+  std::optional<double> instructions_per_second;
+  // Steady state, see bench_simulation()
+  std::optional<double> allocations_per_cycle;
+  std::optional<uint64_t> warmup_allocations;
+};
+
+// Keep the optimiser from discarding a benchmarked result
+template <typename T> void do_not_optimize(const T &value) {
+  asm volatile("" : : "r,m"(value) : "memory");
+}
+
+/**
+ * @brief splitmix64, so that every run benchmarks the same inputs
+ *
+ */
+class Rng {
+private:
+  uint64_t state;
+
+public:
+  explicit Rng(uint64_t seed) : state(seed) {}
+
+  auto next() -> uint64_t {
+    auto z = (state += 0x9e3779b97f4a7c15);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+    return z ^ (z >> 31);
+  }
+
+  auto below(uint32_t bound) -> uint32_t {
+    return static_cast<uint32_t>(next() % bound);
+  }
+};
+
+/**
+ * @brief Best-of-`num_repetitions` wall time of `body`, in nanoseconds
+ *
+ */
+template <typename F>
+auto time_ns(F &&body, int num_repetitions = NUM_REPETITIONS) -> double {
+  auto best = std::numeric_limits<double>::max();
+  for (auto rep = 0; rep < num_repetitions; rep++) {
+    const auto start = std::chrono::steady_clock::now();
+    body();
+    const auto end = std::chrono::steady_clock::now();
+    best = std::min(
+        best, std::chrono::duration<double, std::nano>(end - start).count());
+  }
+  return best;
+}
+
+/**
+ * @brief Mix of private and shared loads, stores and computes per core
+ *
+ * @param num_instructions Per core
+ * @param shared_percent Percentage of accesses to the 64 shared lines; the
+ * rest go to a private 2 KB region that fits in the benchmarked cache
+ * @param seed
+ */
+auto synthetic_traces(int num_instructions, int shared_percent, uint64_t seed)
+    -> std::array<std::vector<Instruction>, NUM_CORES> {
+  auto rng = Rng{seed};
+  auto traces = std::array<std::vector<Instruction>, NUM_CORES>{};
+  for (auto core = 0; core < NUM_CORES; core++) {
+    auto &trace = traces.at(core);
+    trace.reserve(num_instructions);
+    for (auto i = 0; i < num_instructions; i++) {
+      const auto kind = rng.below(10);
+      if (kind == 0) {
+        trace.emplace_back(InstructionType::OTHER, 1 + rng.below(20),
+                           std::nullopt);
+        continue;
+      }
+      const auto is_shared = static_cast<int>(rng.below(100)) < shared_percent;
+      const auto address =
+          is_shared ? 0x1000 + rng.below(64 * BENCH_BLOCK_SIZE / 4) * 4
+                    : ((core + 1) << 20) + rng.below(2048 / 4) * 4;
+      trace.emplace_back(kind <= 6 ? InstructionType::READ
+                                   : InstructionType::WRITE,
+                         std::nullopt, static_cast<int>(address));
+    }
+  }
+  return traces;
+}
+
+auto bench_read_trace(int num_instructions) -> BenchResult {
+  const auto path =
+      std::filesystem::temp_directory_path() / "coherence_bench_trace.data";
+  {
+    auto rng = Rng{1};
+    auto file = std::ofstream{path};
+    for (auto i = 0; i < num_instructions; i++) {
+      file << rng.below(3) << " 0x" << std::hex << rng.below(1 << 24)
+           << std::dec << "\n";
+    }
+  }
+
+  const auto ns = time_ns([&]() { do_not_optimize(read_trace(path).size()); });
+  std::filesystem::remove(path);
+  return {"read_trace", static_cast<uint64_t>(num_instructions),
+          ns / num_instructions, std::nullopt, std::nullopt};
+}
+
+auto bench_is_address_present(int num_ops) -> BenchResult {
+  auto stats_accum =
+      make_statistics_accumulator<MESIProtocol>(BENCH_BLOCK_SIZE);
+  auto bus = std::make_shared<Bus>(NUM_CORES, stats_accum);
+  auto memory_controller = std::make_shared<MemoryController>(stats_accum);
+  auto controller = CacheController<MESIProtocol>{
+      0,   BENCH_CACHE_SIZE,  BENCH_ASSOCIATIVITY, BENCH_BLOCK_SIZE,
+      bus, memory_controller, stats_accum};
+
+  // Fill every way with tags 0..associativity-1; look up twice as many tags
+  // so that half of the lookups miss
+  for (auto set = 0; set < controller.cache.num_sets; set++) {
+    const auto lines = controller.cache.allocated_set_lines(set);
+    for (auto way = 0; way < BENCH_ASSOCIATIVITY; way++) {
+      lines[way].tag = way;
+      lines[way].status = MESIStatus::E;
+    }
+  }
+  auto rng = Rng{2};
+  auto queries = std::vector<std::pair<uint32_t, uint32_t>>(num_ops);
+  for (auto &[set_index, tag] : queries) {
+    set_index = rng.below(controller.cache.num_sets);
+    tag = rng.below(2 * BENCH_ASSOCIATIVITY);
+  }
+
+  const auto ns = time_ns([&]() {
+    for (const auto &[set_index, tag] : queries) {
+      auto [line, is_hit] = controller.is_address_present(set_index, tag);
+      do_not_optimize(is_hit);
+    }
+  });
+  return {"CacheController::is_address_present", static_cast<uint64_t>(num_ops),
+          ns / num_ops, std::nullopt, std::nullopt};
+}
+
+auto bench_propose_evict(int num_ops) -> BenchResult {
+  auto stats_accum =
+      make_statistics_accumulator<MESIProtocol>(BENCH_BLOCK_SIZE);
+  auto bus = std::make_shared<Bus>(NUM_CORES, stats_accum);
+  auto memory_controller = std::make_shared<MemoryController>(stats_accum);
+  auto controller = CacheController<MESIProtocol>{
+      0,   BENCH_CACHE_SIZE,  BENCH_ASSOCIATIVITY, BENCH_BLOCK_SIZE,
+      bus, memory_controller, stats_accum};
+
+  // Full sets, so that the LRU scan has to look at every way
+  auto rng = Rng{3};
+  for (auto set = 0; set < controller.cache.num_sets; set++) {
+    const auto lines = controller.cache.allocated_set_lines(set);
+    for (auto way = 0; way < BENCH_ASSOCIATIVITY; way++) {
+      lines[way].status = MESIStatus::S;
+      lines[way].last_used = static_cast<int>(rng.below(1 << 20));
+    }
+  }
+  auto set_indices = std::vector<uint32_t>(num_ops);
+  for (auto &set_index : set_indices) {
+    set_index = rng.below(controller.cache.num_sets);
+  }
+
+  const auto ns = time_ns([&]() {
+    for (auto set_index : set_indices) {
+      do_not_optimize(controller.propose_evict(set_index));
+    }
+  });
+  return {"CacheController::propose_evict", static_cast<uint64_t>(num_ops),
+          ns / num_ops, std::nullopt, std::nullopt};
+}
+
+auto bench_bus(int num_ops, bool is_contended) -> BenchResult {
+  auto bus = Bus{NUM_CORES};
+  const auto ns = time_ns([&]() {
+    for (auto i = 0; i < num_ops; i++) {
+      if (is_contended) {
+        // Every core asks for the bus; the owner then hands it over
+        for (auto id = 0; id < NUM_CORES; id++) {
+          do_not_optimize(bus.acquire(id));
+        }
+        bus.release(bus.get_owner_id().value());
+      } else {
+        const auto id = i % NUM_CORES;
+        do_not_optimize(bus.acquire(id));
+        bus.release(id);
+      }
+      bus.reset();
+    }
+  });
+  return {is_contended ? "Bus::acquire/release (contended)"
+                       : "Bus::acquire/release",
+          static_cast<uint64_t>(num_ops), ns / num_ops, std::nullopt,
+          std::nullopt};
+}
+
+/**
+ * @brief The bus response lines as std::vector<bool>, aggregated the way the
+ * protocols did before ResponseBits: a scan for the first waiting
+ * controller, a std::reduce for "any present" and a std::for_each to clear
+ *
+ */
+class VectorBoolBits {
+private:
+  std::vector<bool> bits;
+
+public:
+  explicit VectorBoolBits(int num_bits) : bits(num_bits, false) {}
+
+  void set(int id, bool value = true) { bits.at(id) = value; }
+  void reset(int id) { bits.at(id) = false; }
+
+  void reset() {
+    std::for_each(bits.begin(), bits.end(), [](auto &&bit) { bit = false; });
+  }
+
+  auto any() const -> bool {
+    return std::reduce(bits.begin(), bits.end(), false,
+                       [](bool acc, bool bit) { return acc || bit; });
+  }
+
+  auto find_first() const -> std::optional<int> {
+    for (size_t i = 0; i < bits.size(); i++) {
+      if (bits.at(i)) {
+        return static_cast<int>(i);
+      }
+    }
+    return std::nullopt;
+  }
+};
+
+/**
+ * @brief What the requester does with the response lines on each retry
+ * cycle of a miss, once one controller has changed its response: find the
+ * first waiting controller, check whether any cache has the line and clear
+ * the completed line. Only these aggregate operations depend on the number
+ * of controllers.
+ *
+ */
+template <typename Bits>
+auto bench_response_aggregates(const std::string &name, int num_ops,
+                               int num_controllers) -> BenchResult {
+  auto completed = Bits{num_controllers};
+  auto is_present = Bits{num_controllers};
+  auto wait = Bits{num_controllers};
+  auto rng = Rng{7};
+  auto responders = std::vector<int>(num_ops);
+  for (auto &id : responders) {
+    id = static_cast<int>(rng.below(num_controllers));
+  }
+
+  const auto ns = time_ns([&]() {
+    for (auto i = 0; i < num_ops; i++) {
+      const auto id = responders[i];
+      completed.set(id);
+      is_present.set(id, i % 2);
+      wait.set(id, i % 4 == 0);
+
+      if (const auto waiting_id = wait.find_first()) {
+        completed.reset(waiting_id.value());
+      }
+      do_not_optimize(is_present.any());
+      completed.reset();
+      wait.reset(id);
+    }
+  });
+  return {name + " (" + std::to_string(num_controllers) + " cores)",
+          static_cast<uint64_t>(num_ops), ns / num_ops, std::nullopt,
+          std::nullopt};
+}
+
+auto bench_snoop_retries(int num_ops, int num_controllers) -> BenchResult {
+  // A transfer of a 32-byte line: the retries before it is due snoop nobody
+  constexpr auto TRANSFER_CYCLES = 15;
+  auto transaction = SnoopTransaction{num_controllers};
+  auto rng = Rng{8};
+  auto num_snooped = uint64_t{0};
+
+  const auto ns = time_ns([&]() {
+    for (auto i = 0; i < num_ops; i += TRANSFER_CYCLES) {
+      const auto responder = static_cast<int>(rng.below(num_controllers));
+      transaction.open(BusRequest{BusRequestType::BusRd,
+                                  static_cast<uint32_t>(i), 0});
+      transaction.schedule(responder, i + TRANSFER_CYCLES);
+      for (auto cycle = i + 1; cycle <= i + TRANSFER_CYCLES; cycle++) {
+        transaction.for_each_due(cycle, [&](int) { num_snooped++; });
+      }
+      transaction.close();
+    }
+  });
+  do_not_optimize(num_snooped);
+  return {"Snoop retries (" + std::to_string(num_controllers) + " cores)",
+          static_cast<uint64_t>(num_ops), ns / num_ops, std::nullopt,
+          std::nullopt};
+}
+
+auto bench_statistics(int num_ops) -> BenchResult {
+  auto stats_accum =
+      make_statistics_accumulator<MESIProtocol>(BENCH_BLOCK_SIZE);
+  auto rng = Rng{4};
+  auto addresses = std::vector<uint32_t>(num_ops);
+  for (auto &address : addresses) {
+    address = rng.below(1 << 16) * 4;
+  }
+
+  // One op: the updates of a hit, a miss and its bus traffic
+  const auto ns = time_ns([&]() {
+    for (auto i = 0; i < num_ops; i++) {
+      const auto core = i % NUM_CORES;
+      stats_accum->on_read_hit(core, static_cast<int>(MESIStatus::S), i);
+      stats_accum->on_miss(core, i, 100);
+      stats_accum->on_bus_traffic(core, addresses[i],
+                                  BENCH_BLOCK_SIZE / (WORD_SIZE >> 3));
+    }
+  });
+  return {"StatisticsAccumulator updates", static_cast<uint64_t>(num_ops),
+          ns / num_ops, std::nullopt, std::nullopt};
+}
+
+/**
+ * @brief Read and write hits of one core to lines it holds in M, the path
+ * that most accesses of private data take
+ *
+ */
+template <typename Protocol>
+auto bench_hits(const std::string &name, int num_ops) -> BenchResult {
+  const auto config =
+      SystemConfig{BENCH_CACHE_SIZE, BENCH_ASSOCIATIVITY, BENCH_BLOCK_SIZE};
+  auto stats_accum = make_statistics_accumulator<Protocol>(BENCH_BLOCK_SIZE);
+  auto system = System<Protocol>{
+      config, std::array<std::vector<Instruction>, NUM_CORES>{}, stats_accum};
+  auto &controller = *system.cache_controllers.at(0);
+  const auto &cache = controller.cache;
+  for (auto set = 0; set < cache.num_sets; set++) {
+    const auto lines = controller.cache.allocated_set_lines(set);
+    for (auto way = 0; way < BENCH_ASSOCIATIVITY; way++) {
+      lines[way].tag = way;
+      lines[way].status = Protocol::Status::M;
+    }
+  }
+
+  // 70% reads, as in synthetic_traces()
+  auto rng = Rng{4};
+  auto requests = std::vector<std::pair<InstructionType, ParsedAddress>>{};
+  requests.reserve(num_ops);
+  for (auto i = 0; i < num_ops; i++) {
+    const auto type =
+        rng.below(10) < 7 ? InstructionType::READ : InstructionType::WRITE;
+    const auto block = rng.below(BENCH_ASSOCIATIVITY) * cache.num_sets +
+                       rng.below(cache.num_sets);
+    requests.emplace_back(type, parse_address(block * BENCH_BLOCK_SIZE,
+                                              cache.num_offset_bits,
+                                              cache.num_set_index_bits));
+  }
+
+  const auto ns = time_ns([&]() {
+    auto cycle = 0;
+    for (const auto &[type, parsed] : requests) {
+      do_not_optimize(controller.processor_request(type, parsed, cycle++));
+      system.bus->reset();
+    }
+  });
+  return {name + " hits", static_cast<uint64_t>(num_ops), ns / num_ops,
+          std::nullopt, std::nullopt};
+}
+
+template <typename Protocol, typename Geometry = RuntimeGeometry>
+auto bench_simulation(const std::string &name,
+                      const std::array<std::vector<Instruction>, NUM_CORES>
+                          &traces) -> BenchResult {
+  auto num_instructions = uint64_t{0};
+  for (const auto &trace : traces) {
+    num_instructions += trace.size();
+  }
+
+  const auto config =
+      SystemConfig{BENCH_CACHE_SIZE, BENCH_ASSOCIATIVITY, BENCH_BLOCK_SIZE};
+  auto num_cycles = 0;
+  const auto ns = time_ns([&]() {
+    auto stats_accum = make_statistics_accumulator<Protocol>(BENCH_BLOCK_SIZE);
+    auto system = System<Protocol, Geometry>{config, traces, stats_accum};
+    num_cycles = system.run() + 1;
+  }, NUM_SIMULATION_REPETITIONS);
+
+  // Heap allocations of one more run, not counting building the system. The
+  // first half of the run warms up: cache pages touched for the first time,
+  // and the task frame pools and look-ahead buffers growing to their peak.
+  // The second half is the steady state, which should not allocate at all
+  auto stats_accum = make_statistics_accumulator<Protocol>(BENCH_BLOCK_SIZE);
+  auto system = System<Protocol, Geometry>{config, traces, stats_accum};
+  const auto warmup_cycles = num_cycles / 2;
+  const auto allocations_before = num_allocations.load();
+  system.run_until(warmup_cycles);
+  const auto allocations_warm = num_allocations.load();
+  system.run();
+  const auto steady_allocations = num_allocations.load() - allocations_warm;
+
+  return {"simulate " + name,
+          static_cast<uint64_t>(num_cycles),
+          ns / num_cycles,
+          num_cycles / (ns * 1e-9),
+          num_instructions / (ns * 1e-9),
+          steady_allocations / static_cast<double>(num_cycles - warmup_cycles),
+          allocations_warm - allocations_before};
+}
+
+/**
+ * @brief Build a system with a large last-level-sized cache per core and run
+ * `traces` on it, which only touch a few of its sets. Unlike
+ * bench_simulation(), building the system counts.
+ *
+ */
+auto bench_large_cache(const std::array<std::vector<Instruction>, NUM_CORES>
+                           &traces) -> BenchResult {
+  constexpr auto cache_size = 32 << 20;
+  constexpr auto associativity = 8;
+  constexpr auto block_size = 64;
+
+  auto num_instructions = uint64_t{0};
+  for (const auto &trace : traces) {
+    num_instructions += trace.size();
+  }
+  const auto ns = time_ns([&]() {
+    const auto config = SystemConfig{cache_size, associativity, block_size};
+    auto stats_accum = make_statistics_accumulator<MESIProtocol>(block_size);
+    auto system = System<MESIProtocol>{config, traces, stats_accum};
+    do_not_optimize(system.run());
+  }, NUM_SIMULATION_REPETITIONS);
+  return {"build and simulate MESI private, 32 MB caches", num_instructions,
+          ns / num_instructions, std::nullopt, num_instructions / (ns * 1e-9),
+          std::nullopt};
+}
+
+void print_table(const std::vector<BenchResult> &results) {
+  std::cout << std::left << std::setw(42) << "Benchmark" << std::right
+            << std::setw(12) << "Ops" << std::setw(12) << "ns/op"
+            << std::setw(14) << "cycles/s" << std::setw(14) << "instr/s"
+            << std::setw(14) << "allocs/cycle" << std::setw(16)
+            << "warm-up allocs" << "\n";
+  for (const auto &result : results) {
+    std::cout << std::left << std::setw(42) << result.name << std::right
+              << std::setw(12) << result.num_ops << std::setw(12)
+              << std::fixed << std::setprecision(2) << result.ns_per_op
+              << std::setprecision(0) << std::setw(14)
+              << (result.cycles_per_second
+                      ? std::to_string(
+                            static_cast<int64_t>(*result.cycles_per_second))
+                      : "-")
+              << std::setw(14)
+              << (result.instructions_per_second
+                      ? std::to_string(static_cast<int64_t>(
+                            *result.instructions_per_second))
+                      : "-")
+              << std::setw(14)
+              << (result.allocations_per_cycle
+                      ? std::to_string(*result.allocations_per_cycle)
+                      : "-")
+              << std::setw(16)
+              << (result.warmup_allocations
+                      ? std::to_string(*result.warmup_allocations)
+                      : "-")
+              << std::defaultfloat << "\n";
+  }
+}
+
+void write_json(const std::vector<BenchResult> &results,
+                const std::string &path) {
+  auto file = std::ofstream{path};
+  file << "{\n  \"benchmarks\": [\n";
+  for (auto i = 0; i < static_cast<int>(results.size()); i++) {
+    const auto &result = results.at(i);
+    file << "    {\"name\": \"" << result.name
+         << "\", \"ops\": " << result.num_ops
+         << ", \"ns_per_op\": " << result.ns_per_op;
+    if (result.cycles_per_second) {
+      file << ", \"cycles_per_second\": " << *result.cycles_per_second;
+    }
+    if (result.instructions_per_second) {
+      file << ", \"instructions_per_second\": "
+           << *result.instructions_per_second;
+    }
+    if (result.allocations_per_cycle) {
+      file << ", \"allocations_per_cycle\": " << *result.allocations_per_cycle;
+    }
+    if (result.warmup_allocations) {
+      file << ", \"warmup_allocations\": " << *result.warmup_allocations;
+    }
+    file << "}" << (i + 1 < static_cast<int>(results.size()) ? "," : "")
+         << "\n";
+  }
+  file << "  ]\n}\n";
+}
+} // namespace
+
+int main(int argc, char **argv) {
+  argparse::ArgumentParser program{"coherence_bench"};
+  program.add_argument("--json")
+      .help("Path of the JSON results file")
+      .default_value(std::string{"coherence_bench.json"});
+  program.add_argument("--scale")
+      .help("Multiplier on the number of operations of every benchmark")
+      .default_value(1.0)
+      .scan<'g', double>();
+  try {
+    program.parse_args(argc, argv);
+  } catch (const std::runtime_error &err) {
+    std::cerr << err.what() << std::endl;
+    std::cerr << program;
+    std::exit(1);
+  }
+
+  const auto scale = program.get<double>("scale");
+  const auto scaled = [scale](int n) {
+    return std::max(1, static_cast<int>(n * scale));
+  };
+
+  auto results = std::vector<BenchResult>{};
+  results.push_back(bench_read_trace(scaled(200000)));
+  results.push_back(bench_is_address_present(scaled(1000000)));
+  results.push_back(bench_propose_evict(scaled(1000000)));
+  results.push_back(bench_bus(scaled(1000000), false));
+  results.push_back(bench_bus(scaled(1000000), true));
+  for (const auto num_controllers : {NUM_CORES, 32, 64, 256}) {
+    results.push_back(bench_response_aggregates<ResponseBits>(
+        "Response bits", scaled(1000000), num_controllers));
+    results.push_back(bench_response_aggregates<VectorBoolBits>(
+        "Response vector<bool>", scaled(1000000), num_controllers));
+  }
+  for (const auto num_controllers : {NUM_CORES, 64, 256}) {
+    results.push_back(bench_snoop_retries(scaled(1000000), num_controllers));
+  }
+  results.push_back(bench_statistics(scaled(1000000)));
+  results.push_back(bench_hits<MESIProtocol>("MESI", scaled(1000000)));
+  results.push_back(bench_hits<DragonProtocol>("Dragon", scaled(1000000)));
+  results.push_back(bench_hits<MOESIProtocol>("MOESI", scaled(1000000)));
+  results.push_back(bench_hits<MESIFProtocol>("MESIF", scaled(1000000)));
+
+  const auto private_traces = synthetic_traces(scaled(20000), 5, 5);
+  const auto shared_traces = synthetic_traces(scaled(20000), 50, 6);
+  auto decoded_private_traces = private_traces;
+  for (auto &trace : decoded_private_traces) {
+    decode_trace(trace, address_geometry(BENCH_CACHE_SIZE, BENCH_ASSOCIATIVITY,
+                                         BENCH_BLOCK_SIZE));
+  }
+  results.push_back(
+      bench_simulation<MESIProtocol>("MESI private", private_traces));
+  results.push_back(bench_simulation<MESIProtocol>("MESI private predecoded",
+                                                   decoded_private_traces));
+  results.push_back(
+      bench_simulation<MESIProtocol>("MESI shared", shared_traces));
+  // The geometry with_geometry() picks for the bench configuration
+  results.push_back(bench_simulation<MESIProtocol, FixedGeometry<64, 2, 32>>(
+      "MESI shared fixed geometry", shared_traces));
+  results.push_back(
+      bench_simulation<DragonProtocol>("Dragon private", private_traces));
+  results.push_back(
+      bench_simulation<DragonProtocol>("Dragon shared", shared_traces));
+  results.push_back(
+      bench_simulation<MOESIProtocol>("MOESI private", private_traces));
+  results.push_back(
+      bench_simulation<MOESIProtocol>("MOESI shared", shared_traces));
+  results.push_back(
+      bench_simulation<MESIFProtocol>("MESIF private", private_traces));
+  results.push_back(
+      bench_simulation<MESIFProtocol>("MESIF shared", shared_traces));
+  results.push_back(bench_large_cache(private_traces));
+
+  print_table(results);
+  const auto json_path = program.get<std::string>("json");
+  write_json(results, json_path);
+  std::cout << "Results written to " << json_path << std::endl;
+  return 0;
+}
@@ -1,7 +1,11 @@
 #pragma once
+#include "checkpoint.hpp"
+#include "statistics.hpp"
+
+#include <algorithm>
+#include <bit>
 #include <cstdint>
 #include <iostream>
-#include <list>
 #include <memory>
 #include <optional>
 #include <vector>
@@ -12,10 +16,181 @@ struct BusRequest {
   BusRequestType type;
   uint32_t address;
   int controller_id;
+
+  friend auto operator==(const BusRequest &, const BusRequest &)
+      -> bool = default;
 };
 
 auto to_string(const BusRequest &request) -> std::string;
 
+/**
+ * @brief One response line of the bus: a bit per controller, packed into
+ * 64-bit words so that the requester aggregates all responses with a few
+ * word operations whatever the number of controllers.
+ *
+ */
+class ResponseBits {
+private:
+  static constexpr auto BITS_PER_WORD = 64;
+
+  int num_bits;
+  std::vector<uint64_t> words;
+
+public:
+  explicit ResponseBits(int num_bits)
+      : num_bits(num_bits),
+        words((num_bits + BITS_PER_WORD - 1) / BITS_PER_WORD, 0) {}
+
+  auto test(int id) const -> bool {
+    return (words[id / BITS_PER_WORD] >> (id % BITS_PER_WORD)) & 1;
+  }
+
+  void set(int id, bool value = true) {
+    const auto mask = uint64_t{1} << (id % BITS_PER_WORD);
+    auto &word = words[id / BITS_PER_WORD];
+    word = value ? word | mask : word & ~mask;
+  }
+
+  void reset(int id) { set(id, false); }
+
+  /**
+   * @brief Clear every bit
+   *
+   */
+  void reset() { std::fill(words.begin(), words.end(), 0); }
+
+  auto any() const -> bool {
+    return std::any_of(words.begin(), words.end(),
+                       [](auto word) { return word != 0; });
+  }
+
+  /**
+   * @brief Whether some controller has its bit set here and in `other`
+   *
+   * @param other
+   * @return bool
+   */
+  auto intersects(const ResponseBits &other) const -> bool {
+    for (size_t i = 0; i < words.size(); i++) {
+      if (words[i] & other.words[i]) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  /**
+   * @brief Lowest controller id whose bit is set, if any
+   *
+   * @return std::optional<int>
+   */
+  auto find_first() const -> std::optional<int> {
+    for (size_t i = 0; i < words.size(); i++) {
+      if (words[i] != 0) {
+        return static_cast<int>(i) * BITS_PER_WORD +
+               std::countr_zero(words[i]);
+      }
+    }
+    return std::nullopt;
+  }
+
+  /**
+   * @brief Call `f` on every controller id whose bit is set, in increasing
+   * order. `f` may change the bits.
+   *
+   * @param f
+   */
+  template <typename F> void for_each_set(F &&f) const {
+    for (size_t i = 0; i < words.size(); i++) {
+      for (auto word = words[i]; word != 0; word &= word - 1) {
+        f(static_cast<int>(i) * BITS_PER_WORD + std::countr_zero(word));
+      }
+    }
+  }
+
+  // Same layout as a std::vector<bool> in a checkpoint
+  void save(CheckpointWriter &writer) const;
+  void restore(CheckpointReader &reader);
+};
+
+/**
+ * @brief Bookkeeping of the bus request currently being answered. The first
+ * snoop reaches every controller; after that, a retry only reaches the
+ * controllers that still have to be polled (e.g. while writing back) and
+ * those whose scheduled transfer is due, instead of re-broadcasting.
+ *
+ */
+class SnoopTransaction {
+private:
+  int num_controllers;
+  std::optional<BusRequest> request;
+  // Controllers to snoop again on every retry
+  ResponseBits polled;
+  // Controllers with a transfer completing at completion_cycles[id]
+  ResponseBits scheduled;
+  std::vector<int32_t> completion_cycles;
+  int32_t next_completion_cycle = INT32_MAX;
+
+public:
+  explicit SnoopTransaction(int num_controllers)
+      : num_controllers(num_controllers), polled(num_controllers),
+        scheduled(num_controllers), completion_cycles(num_controllers, 0) {}
+
+  auto is_open(const BusRequest &other) const -> bool {
+    return request == other;
+  }
+
+  void open(const BusRequest &new_request) {
+    request = new_request;
+    polled.reset();
+    scheduled.reset();
+    next_completion_cycle = INT32_MAX;
+  }
+
+  void close() { request.reset(); }
+
+  void poll(int id, bool value) { polled.set(id, value); }
+
+  void schedule(int id, int32_t completion_cycle) {
+    scheduled.set(id);
+    completion_cycles.at(id) = completion_cycle;
+    next_completion_cycle = std::min(next_completion_cycle, completion_cycle);
+  }
+
+  /**
+   * @brief Call `f`, in increasing id order, on the controllers to snoop at
+   * `curr_cycle`: the polled ones and those whose transfer is due, which are
+   * unscheduled first
+   *
+   * @param curr_cycle
+   * @param f
+   */
+  template <typename F> void for_each_due(int32_t curr_cycle, F &&f) {
+    if (curr_cycle < next_completion_cycle) {
+      polled.for_each_set(f);
+      return;
+    }
+
+    next_completion_cycle = INT32_MAX;
+    for (auto id = 0; id < num_controllers; id++) {
+      if (scheduled.test(id)) {
+        if (completion_cycles.at(id) > curr_cycle) {
+          next_completion_cycle =
+              std::min(next_completion_cycle, completion_cycles.at(id));
+          continue;
+        }
+        scheduled.reset(id);
+        f(id);
+      } else if (polled.test(id)) {
+        f(id);
+      }
+    }
+  }
+
+  void save(CheckpointWriter &writer) const;
+  void restore(CheckpointReader &reader);
+};
+
 /**
  * @brief Defines a bus that connects all the caches.
  *
@@ -24,28 +199,48 @@ class Bus {
 private:
   bool just_released = false;
   std::optional<int> owner_id;
-  std::list<int> registration_queue;
+  // Controllers waiting for the bus, in order. Each controller queues at most
+  // once, so the capacity reserved up front is never exceeded.
+  std::vector<int> registration_queue;
 
-public:
-  bool already_flush = false;
-  bool already_busrd = false;
+  // Number of consecutive failed acquire() calls per controller
+  std::vector<int> wait_cycles;
+  std::shared_ptr<StatisticsAccumulator> stats_accum;
 
+  void on_acquired(int controller_id);
+
+public:
   // Request Line
   std::optional<BusRequest> request_queue;
 
   // Response Line(s)
-  std::vector<bool> response_completed_bits;
-  std::vector<bool> response_is_present_bits;
-  std::vector<bool> response_wait_bits;
+  ResponseBits response_completed_bits;
+  ResponseBits response_is_present_bits;
+  ResponseBits response_wait_bits;
+
+  // Which controllers the current request still has to reach
+  SnoopTransaction transaction;
 
   // Data line is not simulated since there's no actual data here in the
   // simulator
 
-  Bus(int num_processors);
+  Bus(int num_processors,
+      std::shared_ptr<StatisticsAccumulator> stats_accum = nullptr);
 
   auto acquire(int controller_id) -> int;
   void release(int controller_id);
   auto get_owner_id() -> std::optional<int>;
 
+  /**
+   * @brief Whether nobody owns or is queueing for the bus
+   *
+   */
+  auto is_idle() const -> bool {
+    return !owner_id && registration_queue.empty();
+  }
+
   auto reset() -> void;
+
+  void save(CheckpointWriter &writer) const;
+  void restore(CheckpointReader &reader);
 };
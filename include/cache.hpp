@@ -1,7 +1,10 @@
 #pragma once
 #include "bus.hpp"
+#include "checkpoint.hpp"
 #include "trace.hpp"
 
+#include <algorithm>
+#include <bit>
 #include <cmath>
 #include <cstdint>
 #include <iostream>
@@ -14,22 +17,111 @@
 // Cache Parameters (in bits when appropriate)
 static constexpr auto WORD_SIZE = 32; // 32 bits
 
-struct ParsedAddress {
-  uint32_t tag;
-  uint32_t set_index;
-  uint32_t offset;
-  uint32_t address;
-};
 auto to_string(const ParsedAddress &parsed_address) -> std::string;
 
+/**
+ * @brief Geometry of a cache with the given parameters, as Cache splits its
+ * addresses
+ *
+ * @param cache_size
+ * @param associativity
+ * @param block_size
+ * @return AddressGeometry
+ */
+inline auto address_geometry(int cache_size, int associativity,
+                             int block_size) -> AddressGeometry {
+  const auto num_sets = (cache_size / associativity) / block_size;
+  return AddressGeometry{static_cast<int>(std::log2(block_size)),
+                         static_cast<int>(std::log2(num_sets))};
+}
+
+/**
+ * @brief Bit of a line's word mask for the given offset. Lines longer than 64
+ * words share the last bit among their trailing words.
+ *
+ * @param offset
+ * @return uint64_t
+ */
+inline auto word_mask(uint32_t offset) -> uint64_t {
+  return uint64_t{1} << std::min<uint32_t>(offset / (WORD_SIZE >> 3), 63);
+}
+
+/**
+ * @brief Cache geometry read from the cache at run time, which works for any
+ * configuration
+ *
+ */
+struct RuntimeGeometry {
+  template <typename Cache> static auto num_offset_bits(const Cache &cache) {
+    return cache.num_offset_bits;
+  }
+  template <typename Cache>
+  static auto num_set_index_bits(const Cache &cache) {
+    return cache.num_set_index_bits;
+  }
+  template <typename Cache> static auto associativity(const Cache &cache) {
+    return cache.associativity;
+  }
+
+  static auto matches(int, int, int) -> bool { return true; }
+};
+
+/**
+ * @brief Cache geometry fixed at compile time, so that the shifts and masks
+ * that split addresses and the loops over the ways of a set are constants
+ *
+ */
+template <int Sets, int Ways, int BlockBytes> struct FixedGeometry {
+  static_assert(std::has_single_bit(static_cast<unsigned>(Sets)) &&
+                    std::has_single_bit(static_cast<unsigned>(BlockBytes)),
+                "Sets and BlockBytes must be powers of two");
+
+  template <typename Cache>
+  static constexpr auto num_offset_bits(const Cache &) {
+    return std::countr_zero(static_cast<unsigned>(BlockBytes));
+  }
+  template <typename Cache>
+  static constexpr auto num_set_index_bits(const Cache &) {
+    return std::countr_zero(static_cast<unsigned>(Sets));
+  }
+  template <typename Cache> static constexpr auto associativity(const Cache &) {
+    return Ways;
+  }
+
+  static auto matches(int cache_size, int associativity, int block_size)
+      -> bool {
+    return cache_size == Sets * Ways * BlockBytes && associativity == Ways &&
+           block_size == BlockBytes;
+  }
+};
+
+/**
+ * @brief Split an address for the geometry of `cache`
+ *
+ * @param cache
+ * @param address
+ * @return ParsedAddress
+ */
+template <typename Geometry, typename Cache>
+auto parse_address(const Cache &cache, uint32_t address) -> ParsedAddress {
+  return parse_address(address, Geometry::num_offset_bits(cache),
+                       Geometry::num_set_index_bits(cache));
+}
+
 template <typename Status> struct CacheLine {
   uint32_t tag;
   const uint32_t set_index;
   int last_used;
   Status status;
 
+  // Words read or written (touched) and written by this cache since the line
+  // was last filled, as word masks
+  uint64_t touched_words;
+  uint64_t written_words;
+
   CacheLine(uint32_t set_index)
-      : tag(0), set_index(set_index), last_used(0), status(Status::I) {}
+      : tag(0), set_index(set_index), last_used(0), status(Status::I),
+        touched_words(0), written_words(0) {}
 };
 
 template <typename Status>
@@ -40,27 +132,9 @@ auto to_string(const CacheLine<Status> &cache_line) -> std::string {
          ", status: " + to_string(cache_line.status) + "}";
 }
 
-template <typename Status>
-auto to_string(std::shared_ptr<CacheLine<Status>> cache_line) -> std::string {
-  if (!cache_line) {
-    return "Invalid line!";
-  } else {
-    return to_string(*cache_line);
-  };
-}
-
-template <typename Status> class CacheSet {
-public:
-  std::vector<std::shared_ptr<CacheLine<Status>>> lines;
-  const uint32_t set_index;
-
-  CacheSet(uint32_t set_index, int associativity)
-      : lines(associativity), set_index(set_index) {
-    for (auto &line : lines) {
-      line = std::make_shared<CacheLine<Status>>(set_index);
-    }
-  }
-};
+// Sets are allocated a page at a time, the first time a line of the page is
+// filled. A page holds 2^CACHE_PAGE_BITS sets, or every set of smaller caches.
+static constexpr auto CACHE_PAGE_BITS = 6;
 
 template <typename Protocol> class Cache {
   using Status = typename Protocol::Status;
@@ -69,53 +143,216 @@ public:
   const int num_offset_bits;
   const int num_sets;
   const int num_set_index_bits;
+  const int associativity;
   const int num_words_per_line;
 
-  std::vector<std::shared_ptr<CacheSet<Status>>> sets;
+private:
+  const int num_page_bits;
+  // For each page, where in `arena` set 0 would start if it were in the page,
+  // so that set s of the page starts at page_table[page] + s * associativity
+  std::vector<int64_t> page_table;
+  // A page of invalid lines, which stands for every page that is not
+  // allocated, followed by the allocated pages in the order they were first
+  // filled. Reserved for the whole cache so that lines never move, but only
+  // the allocated pages are constructed, so the rest of the reservation is
+  // normally never resident.
+  std::vector<CacheLine<Status>> arena;
 
+public:
   Cache(int cache_size, int associativity, int block_size)
       : num_offset_bits(std::log2(block_size)),
         num_sets((cache_size / associativity) /
                  block_size), // 64 Sets -> set_index goes from 0 to 63
         num_set_index_bits(std::log2(num_sets)), // 6 bits to address 64 sets
-        num_words_per_line(block_size / (WORD_SIZE >> 3)), sets(num_sets) {
-
-    for (int i = 0; i < num_sets; i++) {
-      sets.at(i) = std::make_shared<CacheSet<Status>>(static_cast<uint32_t>(i),
-                                                      associativity);
+        associativity(associativity),
+        num_words_per_line(block_size / (WORD_SIZE >> 3)),
+        num_page_bits(std::min(num_set_index_bits, CACHE_PAGE_BITS)),
+        page_table(((num_sets - 1) >> num_page_bits) + 1) {
+    arena.reserve(static_cast<size_t>(num_sets + (1 << num_page_bits)) *
+                  associativity);
+    for (auto i = 0; i < (1 << num_page_bits) * associativity; i++) {
+      arena.emplace_back(static_cast<uint32_t>(i / associativity));
+    }
+    for (auto page = size_t{0}; page < page_table.size(); page++) {
+      page_table[page] = -first_set(page) * associativity;
     }
   };
 
   auto read(uint32_t address) -> bool { return fetch(address); }
 
-private:
-  auto parse_address(uint32_t address) -> ParsedAddress {
-    auto offset = address & ((1 << num_offset_bits) - 1);
-    auto set_index =
-        (address >> num_offset_bits) & ((1 << num_set_index_bits) - 1);
-    auto tag = address >> (num_offset_bits + num_set_index_bits);
-    return ParsedAddress{tag, set_index, offset};
+  /**
+   * @brief The `associativity` lines of a set. Those of a set whose page is
+   * not allocated are shared invalid lines: they can be looked up and
+   * invalidated, but a line to fill must be taken from claim_line().
+   *
+   * @param set_index
+   * @return CacheLine<Status> *
+   */
+  template <typename Geometry = RuntimeGeometry>
+  auto set_lines(uint32_t set_index) -> CacheLine<Status> * {
+    const auto num_page_bits =
+        std::min(Geometry::num_set_index_bits(*this), CACHE_PAGE_BITS);
+    return &arena[page_table[set_index >> num_page_bits] +
+                  set_index * Geometry::associativity(*this)];
   }
 
-  auto fetch(uint32_t address) -> Status {
-    auto parsed = parse_address(address);
-    auto set_index = parsed.set_index;
-    auto tag = parsed.tag;
+  /**
+   * @brief The lines of a set, allocating its page if needed
+   *
+   * @param set_index
+   * @return CacheLine<Status> *
+   */
+  auto allocated_set_lines(uint32_t set_index) -> CacheLine<Status> * {
+    const auto page = set_index >> num_page_bits;
+    if (!is_allocated(page)) {
+      allocate_page(page);
+    }
+    return set_lines(set_index);
+  }
+
+  /**
+   * @brief The line to fill for a miss in a set, given the victim that a
+   * lookup of set_lines() chose: the same way of the set's own lines.
+   *
+   * @param set_index
+   * @param victim
+   * @return CacheLine<Status> *
+   */
+  auto claim_line(uint32_t set_index, CacheLine<Status> *victim)
+      -> CacheLine<Status> * {
+    const auto pos = victim - arena.data();
+    if (pos >= (1 << num_page_bits) * associativity) {
+      return victim;
+    }
+    return allocated_set_lines(set_index) + pos % associativity;
+  }
+
+  /**
+   * @brief Call `visit` on each line of the allocated pages, in set order.
+   * The lines of all other sets are invalid.
+   *
+   * @param visit
+   */
+  template <typename Visit> void for_each_line(Visit visit) {
+    visit_lines(*this, visit);
+  }
+  template <typename Visit> void for_each_line(Visit visit) const {
+    visit_lines(*this, visit);
+  }
+
+  /**
+   * @brief Address of the first byte of the block held by a line
+   *
+   * @param line
+   * @return uint32_t
+   */
+  auto line_address(const CacheLine<Status> &line) const -> uint32_t {
+    return (line.tag << (num_offset_bits + num_set_index_bits)) |
+           (line.set_index << num_offset_bits);
+  }
 
-    auto &set = sets.at(set_index);
+  // Each page is saved as a flag telling whether it is allocated, followed by
+  // its lines if it is
+  void save(CheckpointWriter &writer) const {
+    for (auto page = size_t{0}; page < page_table.size(); page++) {
+      writer.write(is_allocated(page));
+      if (!is_allocated(page)) {
+        continue;
+      }
+      const auto first = first_page_line(page);
+      std::for_each(first, first + num_page_lines(page),
+                    [&](const auto &line) {
+                      writer.write(line.tag);
+                      writer.write(line.last_used);
+                      writer.write(line.status);
+                      writer.write(line.touched_words);
+                      writer.write(line.written_words);
+                    });
+    }
+  }
 
-    auto line = [&]() -> std::shared_ptr<CacheLine<Status>> {
-      for (auto &line : set->lines) {
-        if (line->tag == tag) {
-          // Tag is in cache
-          return line;
+  void restore(CheckpointReader &reader) {
+    for (auto page = size_t{0}; page < page_table.size(); page++) {
+      auto is_saved = false;
+      reader.read(is_saved);
+      if (!is_saved && !is_allocated(page)) {
+        continue;
+      }
+      if (!is_allocated(page)) {
+        allocate_page(page);
+      }
+      const auto first = first_page_line(page);
+      std::for_each(first, first + num_page_lines(page), [&](auto &line) {
+        if (is_saved) {
+          reader.read(line.tag);
+          reader.read(line.last_used);
+          reader.read(line.status);
+          reader.read(line.touched_words);
+          reader.read(line.written_words);
+        } else {
+          line.tag = 0;
+          line.last_used = 0;
+          line.status = Status::I;
+          line.touched_words = 0;
+          line.written_words = 0;
         }
+      });
+    }
+  }
+
+private:
+  auto first_set(size_t page) const -> int64_t {
+    return static_cast<int64_t>(page) << num_page_bits;
+  }
+
+  auto num_page_lines(size_t page) const -> int {
+    return std::min<int>(1 << num_page_bits, num_sets - first_set(page)) *
+           associativity;
+  }
+
+  auto first_page_line(size_t page) const {
+    return arena.begin() +
+           (page_table[page] + first_set(page) * associativity);
+  }
+  auto first_page_line(size_t page) {
+    return arena.begin() +
+           (page_table[page] + first_set(page) * associativity);
+  }
+
+  auto is_allocated(size_t page) const -> bool {
+    return first_page_line(page) != arena.begin();
+  }
+
+  // Kept out of line, as it runs once per page
+  [[gnu::noinline]] void allocate_page(size_t page) {
+    page_table[page] = static_cast<int64_t>(arena.size()) -
+                       first_set(page) * associativity;
+    const auto num_lines = num_page_lines(page);
+    for (auto i = 0; i < num_lines; i++) {
+      arena.emplace_back(
+          static_cast<uint32_t>(first_set(page) + i / associativity));
+    }
+  }
+
+  template <typename Self, typename Visit>
+  static void visit_lines(Self &self, Visit &visit) {
+    for (auto page = size_t{0}; page < self.page_table.size(); page++) {
+      if (self.is_allocated(page)) {
+        const auto first = self.first_page_line(page);
+        std::for_each(first, first + self.num_page_lines(page), visit);
       }
-      return std::shared_ptr<CacheLine<Status>>{nullptr};
-    }();
+    }
+  }
 
-    if (line) {
-      if (line->tag == tag && line->status != Status::I) {
+  auto parse_address(uint32_t address) -> ParsedAddress {
+    return ::parse_address(address, num_offset_bits, num_set_index_bits);
+  }
+
+  auto fetch(uint32_t address) -> Status {
+    auto parsed = parse_address(address);
+    const auto lines = set_lines(parsed.set_index);
+    for (auto way = 0; way < associativity; way++) {
+      if (lines[way].tag == parsed.tag && lines[way].status != Status::I) {
         // Hit
         return true;
       }
@@ -1,8 +1,10 @@
 #pragma once
 #include "bus.hpp"
 #include "cache.hpp"
+#include "checkpoint.hpp"
 #include "memory_controller.hpp"
 #include "statistics.hpp"
+#include "task.hpp"
 #include "trace.hpp"
 
 #include <cstdint>
@@ -18,19 +20,57 @@
 
 static constexpr auto CACHE_FLUSH_MULTIPLIER = 2;
 
+template <typename Protocol> struct CacheController;
+
+/**
+ * @brief Non-owning view of the components of one system that the protocol
+ * handlers act on. The system owns the components and builds its context
+ * once, so handlers borrow them without any reference counting.
+ *
+ */
+template <typename Protocol> struct SystemContext {
+  Bus *bus = nullptr;
+  MemoryController *memory_controller = nullptr;
+  StatisticsAccumulator *stats_accum = nullptr;
+  std::vector<CacheController<Protocol> *> cache_controllers;
+};
+
 template <typename Protocol> struct CacheController {
 public:
   using Status = typename Protocol::Status;
   int controller_id = 0;
-  std::shared_ptr<std::tuple<BusRequest, int>> pending_bus_request;
+  // Cache-to-cache transfer being served to the bus, stored in place
+  std::optional<std::tuple<BusRequest, int32_t>> pending_bus_request;
   Cache<Protocol> cache;
   std::shared_ptr<Bus> bus;
 
-  std::vector<std::shared_ptr<CacheController<Protocol>>> cache_controllers;
   std::shared_ptr<MemoryController> memory_controller;
 
   std::shared_ptr<StatisticsAccumulator> stats_accum;
 
+  // Cycle at which the outstanding processor request was first issued
+  std::optional<int32_t> request_start_cycle;
+
+  // Scratch list of other caches' copies, reused by functional_access()
+  std::vector<CacheLine<Status> *> sharers;
+
+  // Set by the owning system, see register_context()
+  const SystemContext<Protocol> *context = nullptr;
+
+  /**
+   * @brief A READ or WRITE whose protocol task is in progress
+   *
+   */
+  struct Access {
+    InstructionType instr_type;
+    bool is_hit;
+    Status state; // Of the line when the access was dispatched
+    uint32_t offset;
+    CacheLine<Status> *line;
+    Task task;
+  };
+  std::optional<Access> access;
+
 public:
   CacheController(int id, int cache_size, int associativity, int block_size,
                   std::shared_ptr<Bus> bus,
@@ -40,108 +80,200 @@ public:
         bus(bus), memory_controller(memory_controller),
         stats_accum(stats_accum) {}
 
-  void register_cache_controllers(
-      std::vector<std::shared_ptr<CacheController<Protocol>>>
-          &cache_controllers) {
-    this->cache_controllers = cache_controllers;
+  /**
+   * @brief Give the controller the context of its system, which must outlive
+   * it. Requests can only be processed once it is registered.
+   *
+   * @param context
+   */
+  void register_context(const SystemContext<Protocol> &context) {
+    this->context = &context;
   }
 
-  void deregister_cache_controllers() { this->cache_controllers.clear(); }
+  /**
+   * @brief Split the address of a READ or WRITE for this cache, unless the
+   * trace was decoded for its geometry already
+   *
+   * @param instr
+   * @return ParsedAddress
+   */
+  template <typename Geometry = RuntimeGeometry>
+  auto decode(const Instruction &instr) const -> ParsedAddress {
+    if (instr.parsed_address) {
+#ifdef DEBUG_FLAG
+      const auto parsed = parse_address(instr.address.value());
+      if (parsed.tag != instr.parsed_address->tag ||
+          parsed.set_index != instr.parsed_address->set_index ||
+          parsed.offset != instr.parsed_address->offset) {
+        std::cerr << "Trace was decoded for another cache geometry!"
+                  << std::endl;
+        std::exit(1);
+      }
+#endif
+      return instr.parsed_address.value();
+    }
+    return ::parse_address<Geometry>(cache, instr.address.value());
+  }
 
   /**
-   * @brief Process a processor request. Returns the resulting instruction
+   * @brief Process a processor request. Returns the resulting instruction,
+   * or nullopt while the access is still pending and the request is to be
+   * made again next cycle
    *
    * @param instr_type
-   * @param address
+   * @param parsed Address of the request, see decode()
    * @param curr_cycle
-   * @return Instruction
+   * @return std::optional<Instruction>
    */
-  auto processor_request(InstructionType instr_type, uint32_t address,
-                         int32_t curr_cycle) -> Instruction {
-
-    switch (instr_type) {
-    case InstructionType::OTHER: {
+  template <typename Geometry = RuntimeGeometry>
+  auto processor_request(InstructionType instr_type,
+                         const ParsedAddress &parsed, int32_t curr_cycle)
+      -> std::optional<Instruction> {
+    if (instr_type == InstructionType::OTHER) {
       // Invalid processor request!
       return Instruction{InstructionType::OTHER, 0, std::nullopt};
-    } break;
-    default: {
-      auto parsed = parse_address(address);
-      auto [line, is_hit] = is_address_present(parsed.set_index, parsed.tag);
+    }
+    if (!request_start_cycle) {
+      request_start_cycle = curr_cycle;
+    }
 
+    if (!access) {
+      auto [line, is_hit] =
+          find_line<Geometry>(parsed.set_index, parsed.tag);
+      const auto state = line->status;
+
+      if (is_hit && instr_type == InstructionType::READ) {
+        // Read hits never need the bus, so they take no task
+        auto instr = Protocol::handle_read_hit(controller_id, curr_cycle,
+                                               parsed, line, *context);
+        on_access_end(instr, instr_type, is_hit, state, parsed.offset, *line,
+                      curr_cycle);
+        return instr;
+      }
+
+      // Tasks start once the bus is ours. Until then the access is
+      // dispatched afresh on every cycle, since another cache's request may
+      // invalidate the line or change the victim in the meantime
+      if (!bus->acquire(controller_id)) {
+        stats_accum->on_idle(controller_id, curr_cycle);
+        return std::nullopt;
+      }
       if (is_hit) {
-        switch (instr_type) {
-        case InstructionType::READ: {
-          const auto state = line->status;
-          auto instr = Protocol::handle_read_hit(
-              controller_id, curr_cycle, parsed, cache_controllers, bus, line,
-              memory_controller, stats_accum);
-
-          if (is_null_instr(instr)) {
-            stats_accum->on_read_hit(controller_id, static_cast<int>(state),
-                                     curr_cycle);
-          } else {
-            stats_accum->on_idle(controller_id, curr_cycle);
-          }
+        // Nor do write hits in a private state, done once they have the bus
+        if (auto instr = Protocol::handle_local_write_hit(
+                controller_id, curr_cycle, parsed, line, *context)) {
+          on_access_end(*instr, instr_type, is_hit, state, parsed.offset,
+                        *line, curr_cycle);
           return instr;
         }
-        case InstructionType::WRITE: {
-          const auto state = line->status;
-          auto instr = Protocol::handle_write_hit(
-              controller_id, curr_cycle, parsed, cache_controllers, bus, line,
-              memory_controller, stats_accum);
-          if (is_null_instr(instr)) {
-            stats_accum->on_write_hit(controller_id, static_cast<int>(state),
-                                      curr_cycle);
-          } else {
-            stats_accum->on_idle(controller_id, curr_cycle);
-          }
-          return instr;
-        }
-        default:
-          return Instruction{InstructionType::OTHER, 0, std::nullopt};
-        }
       } else {
-        switch (instr_type) {
-        case InstructionType::READ: {
-          auto instr = Protocol::handle_read_miss(
-              controller_id, curr_cycle, parsed, cache_controllers, bus, line,
-              memory_controller, stats_accum);
-          if (!is_null_instr(instr)) {
-            stats_accum->on_idle(controller_id, curr_cycle);
-          }
-          return instr;
-        }
-        case InstructionType::WRITE: {
-          auto instr = Protocol::handle_write_miss(
-              controller_id, curr_cycle, parsed, cache_controllers, bus, line,
-              memory_controller, stats_accum);
-          if (!is_null_instr(instr)) {
-            stats_accum->on_idle(controller_id, curr_cycle);
-          }
-          return instr;
-        }
-        default:
-          return Instruction{InstructionType::OTHER, 0, std::nullopt};
-        }
+        // A victim in a set never filled yet is one of the shared lines
+        line = cache.claim_line(parsed.set_index, line);
       }
+      auto task = is_hit ? Protocol::handle_write_hit(controller_id,
+                                                      curr_cycle, parsed,
+                                                      line, *context)
+                 : instr_type == InstructionType::READ
+                     ? Protocol::handle_read_miss(controller_id, curr_cycle,
+                                                  parsed, line, *context)
+                     : Protocol::handle_write_miss(controller_id, curr_cycle,
+                                                   parsed, line, *context);
+      access.emplace(instr_type, is_hit, state, parsed.offset, line,
+                     std::move(task));
     }
+
+    if (!access->task.run_once(curr_cycle)) {
+      stats_accum->on_idle(controller_id, curr_cycle);
+      return std::nullopt;
     }
-    return Instruction{InstructionType::OTHER, 0, std::nullopt};
+    const auto instr = access->task.result();
+    // Only write hits that handle_local_write_hit() left to a task get here
+    on_access_end(instr, instr_type, access->is_hit, access->state,
+                  access->offset, *access->line, curr_cycle, true);
+    access.reset();
+    return instr;
   }
 
-  auto get_interesting_cache_lines() {
-    std::cout << "Cache " << controller_id << ": " << std::endl;
-    for (std::shared_ptr<CacheSet<Status>> cache_set_ptr : cache.sets) {
-      for (auto line : cache_set_ptr->lines) {
-        if (line->status != Status::I) {
-          std::cout << "\t" << to_string(line) << std::endl;
-        }
+  /**
+   * @brief Whether a bus transaction of this cache is in progress. Its task
+   * cannot be checkpointed.
+   *
+   */
+  auto is_in_transaction() const -> bool { return access.has_value(); }
+
+  /**
+   * @brief Perform a READ or WRITE in zero time: update this cache's and the
+   * other caches' lines as the timed protocol would, but leave the bus, the
+   * memory controller and the statistics untouched. Used for warm-up.
+   *
+   * @param instr_type
+   * @param parsed Address of the access, see decode()
+   * @param stamp LRU stamp of the access
+   */
+  template <typename Geometry = RuntimeGeometry>
+  void functional_access(InstructionType instr_type,
+                         const ParsedAddress &parsed, int32_t stamp) {
+    auto [line, is_hit] = find_line<Geometry>(parsed.set_index, parsed.tag);
+    const auto mask = word_mask(parsed.offset);
+
+    // No protocol changes any state on a read hit
+    if (is_hit && instr_type == InstructionType::READ) {
+      line->touched_words |= mask;
+      return;
+    }
+    if (!is_hit) {
+      line = cache.claim_line(parsed.set_index, line);
+    }
+
+    sharers.clear();
+    for (auto cache_controller : context->cache_controllers) {
+      if (cache_controller == this) {
+        continue;
+      }
+      auto [other, is_other_hit] =
+          cache_controller->template find_line<Geometry>(parsed.set_index,
+                                                         parsed.tag);
+      if (is_other_hit) {
+        sharers.push_back(other);
       }
     }
+
+    Protocol::handle_functional_access(instr_type, parsed.tag, stamp, is_hit,
+                                       *line, sharers);
+
+    if (instr_type == InstructionType::READ) {
+      line->touched_words = mask;
+      line->written_words = 0;
+    } else {
+      line->touched_words = is_hit ? line->touched_words | mask : mask;
+      line->written_words = is_hit ? line->written_words | mask : mask;
+    }
+  }
+
+  /**
+   * @brief Shift the LRU stamps of every line by `offset` cycles. Stamps
+   * saturate at the oldest representable value.
+   *
+   * @param offset
+   */
+  void shift_last_used(int64_t offset) {
+    cache.for_each_line([&](auto &line) {
+      line.last_used = static_cast<int32_t>(
+          std::max<int64_t>(line.last_used + offset, INT32_MIN));
+    });
   }
 
-  void receive_bus_request() {
-    if (bus->response_completed_bits.at(controller_id)) {
+  auto get_interesting_cache_lines(std::ostream &os = std::cout) {
+    os << "Cache " << controller_id << ": " << std::endl;
+    cache.for_each_line([&](const auto &line) {
+      if (line.status != Status::I) {
+        os << "\t" << to_string(line) << std::endl;
+      }
+    });
+  }
+
+  void receive_bus_request(int32_t curr_cycle) {
+    if (bus->response_completed_bits.test(controller_id)) {
 #ifdef DEBUG_FLAG
       std::cout << "\t\tCache " << controller_id << " already responded!"
                 << std::endl;
@@ -153,9 +285,9 @@ public:
     const auto &request = bus->request_queue.value();
     // Always ignore requests from the same cache
     if (request.controller_id == controller_id) {
-      bus->response_wait_bits.at(controller_id) = false;
-      bus->response_completed_bits.at(controller_id) = true;
-      bus->response_is_present_bits.at(controller_id) = false;
+      bus->response_wait_bits.reset(controller_id);
+      bus->response_completed_bits.set(controller_id);
+      bus->response_is_present_bits.reset(controller_id);
 #ifdef DEBUG_FLAG
       std::cout << "\t\tCache " << controller_id
                 << " is issuer -> Skip response!" << std::endl;
@@ -166,63 +298,256 @@ public:
 
     auto parsed_address = parse_address(request.address);
     auto [line, is_hit] =
-        is_address_present(parsed_address.set_index, parsed_address.tag);
+        find_line(parsed_address.set_index, parsed_address.tag);
 
-    pending_bus_request = Protocol::handle_bus_request(
-        request, bus, controller_id, pending_bus_request, is_hit,
-        cache.num_words_per_line, line, memory_controller, stats_accum);
-    return;
+    const auto had_pending = pending_bus_request.has_value();
+    Protocol::handle_bus_request(request, controller_id, pending_bus_request,
+                                 is_hit, cache.num_words_per_line, line,
+                                 *context);
+    if (!had_pending && pending_bus_request) {
+      // Only snooped again once the transfer is due
+      bus->transaction.schedule(controller_id,
+                                curr_cycle +
+                                    std::get<1>(*pending_bus_request));
+    }
   }
 
-  void reset_bus_request() { pending_bus_request = nullptr; }
+  void reset_bus_request() { pending_bus_request.reset(); }
 
-private:
-  auto parse_address(uint32_t address) -> ParsedAddress {
-    auto offset = address & ((1 << cache.num_offset_bits) - 1);
-    auto set_index = (address >> cache.num_offset_bits) &
-                     ((1 << cache.num_set_index_bits) - 1);
-    auto tag = address >> (cache.num_offset_bits + cache.num_set_index_bits);
-    return ParsedAddress{tag, set_index, offset, address};
+  auto has_pending_bus_request() const -> bool {
+    return pending_bus_request.has_value();
+  }
+
+  /**
+   * @brief Whether a READ of `parsed` would hit
+   *
+   * @param parsed
+   * @return bool
+   */
+  template <typename Geometry = RuntimeGeometry>
+  auto has_valid_line(const ParsedAddress &parsed) -> bool {
+    return std::get<1>(find_line<Geometry>(parsed.set_index, parsed.tag));
+  }
+
+  /**
+   * @brief Whether a WRITE of `parsed` would hit in a private state, which
+   * takes the bus for its own cycle only and involves no other cache
+   *
+   * @param parsed
+   * @return bool
+   */
+  template <typename Geometry = RuntimeGeometry>
+  auto has_private_line(const ParsedAddress &parsed) -> bool {
+    const auto [line, is_hit] =
+        find_line<Geometry>(parsed.set_index, parsed.tag);
+    return is_hit &&
+           stats_accum->is_private_state(static_cast<int>(line->status));
+  }
+
+  void save(CheckpointWriter &writer) const {
+    if (access) {
+      std::cerr << "Cache " << controller_id
+                << " cannot be saved in the middle of a bus transaction!"
+                << std::endl;
+      std::exit(1);
+    }
+    writer.write(pending_bus_request.has_value());
+    if (pending_bus_request) {
+      const auto &[request, cycles_left] = *pending_bus_request;
+      writer.write(request);
+      writer.write(cycles_left);
+    }
+    writer.write(request_start_cycle);
+    cache.save(writer);
+  }
+
+  void restore(CheckpointReader &reader) {
+    auto has_pending_bus_request = false;
+    reader.read(has_pending_bus_request);
+    pending_bus_request.reset();
+    if (has_pending_bus_request) {
+      auto request = BusRequest{};
+      auto cycles_left = int32_t{0};
+      reader.read(request);
+      reader.read(cycles_left);
+      pending_bus_request.emplace(request, cycles_left);
+    }
+    reader.read(request_start_cycle);
+    cache.restore(reader);
   }
 
   /**
    * @brief Propose a line to be evicted from the cache. Uses the LRU policy.
    *
-   * @param address
-   * @return uint32_t
+   * @param set_index
+   * @return CacheLine<Status> *
    */
-  auto propose_evict(std::shared_ptr<CacheSet<Status>> set)
-      -> std::shared_ptr<CacheLine<Status>> {
-    auto line_idx = 0;
+  auto propose_evict(uint32_t set_index) -> CacheLine<Status> * {
+    const auto lines = cache.set_lines(set_index);
     auto oldest_line_idx = 0;
     auto oldest = -1;
-    for (auto &line : set->lines) {
-      if (line->status == Status::I) {
+    for (auto way = 0; way < cache.associativity; way++) {
+      const auto &line = lines[way];
+      if (line.status == Status::I) {
         // Evict this line
-        return line;
+        return &lines[way];
       } else if (oldest == -1) { // First line
-        oldest = line->last_used;
-        oldest_line_idx = line_idx;
-      } else if (line->last_used <= oldest) {
-        oldest = line->last_used;
-        oldest_line_idx = line_idx;
+        oldest = line.last_used;
+        oldest_line_idx = way;
+      } else if (line.last_used <= oldest) {
+        oldest = line.last_used;
+        oldest_line_idx = way;
       }
-      line_idx += 1;
     }
 
-    return set->lines.at(oldest_line_idx);
+    return &lines[oldest_line_idx];
   }
 
   auto is_address_present(uint32_t set_index, uint32_t tag)
-      -> std::tuple<std::shared_ptr<CacheLine<Status>>, bool> {
-    auto &set = cache.sets.at(set_index);
-    for (auto &line : set->lines) {
-      if (line->tag == tag && line->status != Status::I) {
+      -> std::tuple<CacheLine<Status> *, bool> {
+    const auto lines = cache.set_lines(set_index);
+    for (auto way = 0; way < cache.associativity; way++) {
+      if (lines[way].tag == tag && lines[way].status != Status::I) {
         // Tag is in cache and is valid
+        return {&lines[way], true};
+      }
+    }
+    return {propose_evict(set_index), false};
+  }
+
+  /**
+   * @brief Same lookup as is_address_present() and propose_evict(), in a
+   * single pass over the ways. With a FixedGeometry, that loop has a
+   * constant trip count.
+   *
+   * @param set_index
+   * @param tag
+   * @return std::tuple<CacheLine<Status> *, bool>
+   */
+  template <typename Geometry = RuntimeGeometry>
+  auto find_line(uint32_t set_index, uint32_t tag)
+      -> std::tuple<CacheLine<Status> *, bool> {
+    const auto lines = cache.template set_lines<Geometry>(set_index);
+    auto victim = static_cast<CacheLine<Status> *>(nullptr);
+    for (auto way = 0; way < Geometry::associativity(cache); way++) {
+      const auto line = &lines[way];
+      if (line->tag == tag && line->status != Status::I) {
         return {line, true};
       }
+      if (victim == nullptr || (victim->status != Status::I &&
+                                (line->status == Status::I ||
+                                 line->last_used <= victim->last_used))) {
+        victim = line;
+      }
     }
-    auto line = propose_evict(set);
-    return {line, false};
+    return {victim, false};
+  }
+
+private:
+  /**
+   * @brief Count the access if `instr` completed it, or one more idle cycle.
+   * A write hit that the protocol could not complete locally went on the bus
+   * to invalidate or update the other copies, and counts as an upgrade.
+   *
+   */
+  void on_access_end(const Instruction &instr, InstructionType instr_type,
+                     bool is_hit, Status state, uint32_t offset,
+                     CacheLine<Status> &line, int32_t curr_cycle,
+                     bool needed_bus = false) {
+    if (!is_null_instr(instr)) {
+      stats_accum->on_idle(controller_id, curr_cycle);
+      return;
+    }
+
+    const auto mask = word_mask(offset);
+    if (is_hit) {
+      line.touched_words |= mask;
+      if (instr_type == InstructionType::READ) {
+        stats_accum->on_read_hit(controller_id, static_cast<int>(state),
+                                 curr_cycle);
+      } else {
+        stats_accum->on_write_hit(controller_id, static_cast<int>(state),
+                                  curr_cycle);
+        line.written_words |= mask;
+        if (needed_bus) {
+          stats_accum->on_upgrade(controller_id, request_latency(curr_cycle));
+        }
+      }
+    } else {
+      stats_accum->on_miss(controller_id, curr_cycle,
+                           request_latency(curr_cycle));
+      line.touched_words = mask;
+      line.written_words =
+          instr_type == InstructionType::WRITE ? mask : uint64_t{0};
+    }
+    request_start_cycle = std::nullopt;
+  }
+
+  auto request_latency(int32_t curr_cycle) const -> int {
+    return curr_cycle - request_start_cycle.value_or(curr_cycle) + 1;
+  }
+
+  auto parse_address(uint32_t address) const -> ParsedAddress {
+    return ::parse_address(address, cache.num_offset_bits,
+                           cache.num_set_index_bits);
+  }
+};
+/**
+ * @brief Put `request` on the bus and snoop the other caches. The first call
+ * for a request reaches every cache; the requester's retries then only reach
+ * the caches that still have to answer it, see SnoopTransaction.
+ *
+ * @param request
+ * @param curr_cycle
+ * @param context
+ */
+template <typename Protocol>
+void broadcast(const BusRequest &request, int32_t curr_cycle,
+               const SystemContext<Protocol> &context) {
+  auto &bus = *context.bus;
+  const auto snoop = [&](int id) {
+    auto &cache_controller = *context.cache_controllers.at(id);
+    cache_controller.receive_bus_request(curr_cycle);
+    bus.transaction.poll(id, !bus.response_completed_bits.test(id) &&
+                                 !cache_controller.has_pending_bus_request());
+  };
+
+  if (bus.transaction.is_open(request)) {
+    bus.transaction.for_each_due(curr_cycle, snoop);
+  } else {
+    bus.request_queue = request;
+    bus.transaction.open(request);
+    for (size_t id = 0; id < context.cache_controllers.size(); id++) {
+      snoop(static_cast<int>(id));
+    }
+  }
+
+  if (!bus.response_wait_bits.any()) {
+    // The requester goes on, so the next request starts afresh
+    bus.transaction.close();
+  }
+}
+
+/**
+ * @brief Broadcast `request` and check the responses. Returns whether no
+ * cache is still transferring the line; otherwise the first one that is has
+ * its response reset, and the request is to be retried on the next cycle.
+ *
+ * @param request
+ * @param curr_cycle
+ * @param context
+ * @return bool
+ */
+template <typename Protocol>
+auto collect_responses(const BusRequest &request, int32_t curr_cycle,
+                       const SystemContext<Protocol> &context) -> bool {
+  broadcast(request, curr_cycle, context);
+
+  const auto waiting_id = context.bus->response_wait_bits.find_first();
+  if (waiting_id) {
+    // Reset the pending cache's information
+    context.bus->response_completed_bits.reset(waiting_id.value());
+    return false;
   }
-};
\ No newline at end of file
+  return true;
+}
@@ -0,0 +1,138 @@
+#pragma once
+
+#include "trace_source.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+// Checkpoints start with this magic, followed by a CheckpointHeader and the
+// state of each component in a fixed order
+static constexpr char CHECKPOINT_MAGIC[8] = {'C', 'O', 'H', 'C',
+                                             'K', 'P', '0', '7'};
+
+struct CheckpointHeader {
+  char magic[sizeof(CHECKPOINT_MAGIC)];
+  char protocol[16];
+  int32_t num_cores;
+  int32_t cache_size;
+  int32_t associativity;
+  int32_t block_size;
+  int32_t cycle; // Last simulated cycle
+  int32_t write_buffer; // Whether the simulator was built with a write buffer
+  TraceIdentity trace;
+};
+
+/**
+ * @brief Serialises simulator state into a flat buffer of native-endian
+ * values. Only trivially copyable values are written as raw bytes, so the
+ * layout matches what CheckpointReader expects field by field.
+ *
+ */
+class CheckpointWriter {
+private:
+  std::vector<char> buffer;
+
+  void append(const void *data, size_t size) {
+    const auto bytes = static_cast<const char *>(data);
+    buffer.insert(buffer.end(), bytes, bytes + size);
+  }
+
+public:
+  template <typename T> void write(const T &value) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    append(&value, sizeof(T));
+  }
+
+  template <typename T> void write(const std::optional<T> &value) {
+    write(static_cast<uint8_t>(value.has_value()));
+    if (value) {
+      write(value.value());
+    }
+  }
+
+  template <typename T> void write(const std::vector<T> &values) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    write(static_cast<uint64_t>(values.size()));
+    append(values.data(), values.size() * sizeof(T));
+  }
+
+  void write(const std::vector<bool> &values);
+
+  /**
+   * @brief Write the buffer to a file, replacing it if it exists
+   *
+   * @param path
+   */
+  void save(const std::filesystem::path &path) const;
+};
+
+/**
+ * @brief Reads a checkpoint back from a memory-mapped file. Any read past
+ * the end of the file is reported as a corrupt checkpoint.
+ *
+ */
+class CheckpointReader {
+private:
+  const char *data = nullptr;
+  size_t size = 0;
+  size_t pos = 0;
+
+  void consume(void *out, size_t num_bytes);
+
+public:
+  explicit CheckpointReader(const std::filesystem::path &path);
+  ~CheckpointReader();
+
+  CheckpointReader(const CheckpointReader &) = delete;
+  auto operator=(const CheckpointReader &) -> CheckpointReader & = delete;
+
+  template <typename T> void read(T &value) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    consume(&value, sizeof(T));
+  }
+
+  template <typename T> void read(std::optional<T> &value) {
+    auto has_value = uint8_t{0};
+    read(has_value);
+    if (has_value) {
+      auto inner = T{};
+      read(inner);
+      value = inner;
+    } else {
+      value = std::nullopt;
+    }
+  }
+
+  template <typename T> void read(std::vector<T> &values) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    auto num_values = uint64_t{0};
+    read(num_values);
+    values.resize(num_values);
+    consume(values.data(), num_values * sizeof(T));
+  }
+
+  void read(std::vector<bool> &values);
+
+  auto is_at_end() const -> bool { return pos == size; }
+};
+
+auto make_checkpoint_header(const std::string &protocol, int num_cores,
+                            int cache_size, int associativity,
+                            int block_size, int cycle,
+                            const TraceIdentity &trace) -> CheckpointHeader;
+
+/**
+ * @brief Check that a checkpoint was taken with the given configuration,
+ * memory model and traces. Exits with an error describing the first mismatch
+ * otherwise.
+ *
+ */
+void check_checkpoint_header(const CheckpointHeader &header,
+                             const std::string &protocol, int num_cores,
+                             int cache_size, int associativity,
+                             int block_size, const TraceIdentity &trace);
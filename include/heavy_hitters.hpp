@@ -0,0 +1,117 @@
+#pragma once
+
+#include "checkpoint.hpp"
+
+#include <array>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+static constexpr auto SKETCH_DEPTH = 4;
+static constexpr auto SKETCH_WIDTH = 2048; // Must be a power of two
+static constexpr auto NUM_HEAVY_HITTERS = 32;
+static constexpr auto NUM_HOT_LINES_REPORTED = 10;
+
+/**
+ * @brief Count-Min sketch over 32-bit keys. Estimates never undercount, and
+ * overcount by at most e / SKETCH_WIDTH of the total weight with probability
+ * 1 - e^-SKETCH_DEPTH.
+ *
+ */
+class CountMinSketch {
+private:
+  std::vector<uint64_t> counters; // SKETCH_DEPTH rows of SKETCH_WIDTH
+  uint64_t total = 0;
+
+  static auto bucket(int row, uint32_t key) -> int;
+
+public:
+  CountMinSketch();
+
+  void add(uint32_t key, uint64_t weight);
+  auto estimate(uint32_t key) const -> uint64_t;
+  auto total_weight() const -> uint64_t { return total; }
+
+  /**
+   * @brief Additive error bound of estimate()
+   *
+   */
+  auto error_bound() const -> uint64_t;
+
+  void save(CheckpointWriter &writer) const;
+  void restore(CheckpointReader &reader);
+};
+
+/**
+ * @brief Space-Saving top-k over 32-bit keys with NUM_HEAVY_HITTERS counters.
+ * Every key whose weight exceeds total / NUM_HEAVY_HITTERS is monitored, and a
+ * monitored key's true weight lies in [count - error, count].
+ *
+ */
+class SpaceSaving {
+public:
+  struct Entry {
+    uint32_t key;
+    uint64_t count;
+    uint64_t error;
+  };
+
+private:
+  std::array<Entry, NUM_HEAVY_HITTERS> entries{};
+  int size = 0;
+
+public:
+  /**
+   * @brief Count `weight` more for `key`. Returns the index of its counter,
+   * and whether the key has just taken that counter over
+   *
+   */
+  auto add(uint32_t key, uint64_t weight) -> std::pair<int, bool>;
+
+  /**
+   * @brief Monitored entries, heaviest first
+   *
+   */
+  auto top() const -> std::vector<Entry>;
+
+  auto num_monitored() const -> int { return size; }
+  auto entry(int index) const -> const Entry & { return entries[index]; }
+
+  void save(CheckpointWriter &writer) const;
+  void restore(CheckpointReader &reader);
+};
+
+/**
+ * @brief Fixed-memory tracker of the heaviest lines for one kind of event.
+ * Space-Saving picks the candidates; the sketch tightens their upper bounds.
+ *
+ */
+class HeavyHitterTracker {
+private:
+  CountMinSketch sketch;
+  SpaceSaving top_k;
+
+public:
+  void add(uint32_t line_address, uint64_t weight = 1) {
+    sketch.add(line_address, weight);
+    top_k.add(line_address, weight);
+  }
+
+  /**
+   * @brief Print the heaviest lines with `[lower, upper]` bounds on their
+   * weight
+   *
+   */
+  void print(std::ostream &os, const std::string &label) const;
+
+  void save(CheckpointWriter &writer) const {
+    sketch.save(writer);
+    top_k.save(writer);
+  }
+  void restore(CheckpointReader &reader) {
+    sketch.restore(reader);
+    top_k.restore(reader);
+  }
+};
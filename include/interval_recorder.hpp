@@ -0,0 +1,95 @@
+#pragma once
+
+#include "statistics.hpp"
+
+#include <condition_variable>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+static constexpr auto INTERVAL_RING_CAPACITY = 1024;
+
+/**
+ * @brief One snapshot of the per-core counters, taken at the end of an
+ * interval. Counters are deltas over the interval, not running totals.
+ *
+ */
+struct IntervalSnapshot {
+  int end_cycle = 0;
+  std::vector<CoreCounters> cores;
+};
+
+/**
+ * @brief Samples the statistics every `interval` cycles into a preallocated
+ * ring buffer. A background thread drains the ring buffer to a CSV file, so
+ * the simulation loop only pays for a copy of the counters. If the writer
+ * falls behind by more than the ring capacity, the simulation blocks until a
+ * slot is free rather than dropping samples.
+ *
+ */
+class IntervalRecorder {
+private:
+  const int num_cores;
+  const int interval;
+
+  std::vector<IntervalSnapshot> ring;
+  uint64_t head = 0; // Next slot to be written by the simulation
+  uint64_t tail = 0; // Next slot to be flushed by the writer
+
+  std::vector<CoreCounters> previous;
+  int last_end_cycle = 0;
+
+  std::ofstream output;
+  std::mutex mutex;
+  std::condition_variable not_empty;
+  std::condition_variable not_full;
+  bool stopped = false;
+  std::thread writer;
+
+  void write_loop();
+
+public:
+  IntervalRecorder(int num_cores, int interval, const std::string &path,
+                   int capacity = INTERVAL_RING_CAPACITY);
+  ~IntervalRecorder();
+
+  IntervalRecorder(const IntervalRecorder &) = delete;
+  auto operator=(const IntervalRecorder &) -> IntervalRecorder & = delete;
+
+  /**
+   * @brief Continue a run restored at the end of `cycle`: the next interval
+   * only counts events after it
+   *
+   */
+  void resume(int cycle, const StatisticsAccumulator &stats_accum);
+
+  auto is_due(int cycle) const -> bool { return (cycle + 1) % interval == 0; }
+
+  /**
+   * @brief Number of cycles after `cycle` until the next one that is due
+   *
+   */
+  auto cycles_until_due(int cycle) const -> int {
+    return interval - (cycle + 1) % interval;
+  }
+
+  /**
+   * @brief Record the interval ending at (and including) `cycle`
+   *
+   * @param cycle
+   * @param stats_accum
+   */
+  void record(int cycle, const StatisticsAccumulator &stats_accum);
+
+  /**
+   * @brief Record the trailing partial interval, then flush and stop the
+   * writer thread
+   *
+   * @param cycle Last simulated cycle
+   * @param stats_accum
+   */
+  void close(int cycle, const StatisticsAccumulator &stats_accum);
+};
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "checkpoint.hpp"
+
+#include <array>
+#include <cstdint>
+#include <string>
+
+/**
+ * @brief Fixed-memory, log-bucketed latency histogram (HDR-style).
+ *
+ * Values below 2^SUB_BUCKET_BITS are recorded exactly. Larger values are
+ * grouped by their most significant bit, and each power-of-two range is split
+ * into 2^(SUB_BUCKET_BITS - 1) linear sub-buckets, so the relative error of a
+ * reported percentile is bounded by 2^-(SUB_BUCKET_BITS - 1).
+ *
+ */
+class LatencyHistogram {
+public:
+  static constexpr auto SUB_BUCKET_BITS = 4;
+  static constexpr auto SUB_BUCKET_COUNT = 1 << SUB_BUCKET_BITS;
+  static constexpr auto HALF_SUB_BUCKET_COUNT = SUB_BUCKET_COUNT >> 1;
+  // Enough buckets to cover every non-negative 32-bit value
+  static constexpr auto NUM_BUCKETS =
+      (32 - SUB_BUCKET_BITS) * HALF_SUB_BUCKET_COUNT + SUB_BUCKET_COUNT;
+
+private:
+  std::array<uint64_t, NUM_BUCKETS> counts{};
+  uint64_t total = 0;
+  int64_t sum = 0;
+  int max_value = 0;
+
+  static auto bucket_index(int value) -> int;
+  static auto bucket_upper_bound(int index) -> int;
+
+public:
+  void record(int value);
+
+  auto count() const -> uint64_t { return total; }
+  auto max() const -> int { return max_value; }
+  auto mean() const -> double;
+
+  /**
+   * @brief Smallest recorded value v such that at least `percentile` percent
+   * of the samples are <= v, up to the bucket resolution
+   *
+   * @param percentile In [0, 100]
+   * @return int
+   */
+  auto value_at_percentile(double percentile) const -> int;
+
+  auto summary() const -> std::string;
+
+  void save(CheckpointWriter &writer) const;
+  void restore(CheckpointReader &reader);
+};
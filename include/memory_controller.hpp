@@ -1,10 +1,13 @@
 #pragma once
 #include "bus.hpp"
 #include "cache.hpp"
+#include "checkpoint.hpp"
 #include "statistics.hpp"
+#include "task.hpp"
 #include "trace.hpp"
 #include "write_buffer.hpp"
 
+#include <algorithm>
 #include <memory>
 
 constexpr auto MEMORY_MISS_PENALTY = 100;
@@ -18,6 +21,10 @@ private:
 
   int delay = 0;
 
+  // Cycles elapsed, used to time write-back stalls
+  int cycle = 0;
+  int write_back_start_cycle = 0;
+
   std::shared_ptr<StatisticsAccumulator> stats_accum;
 
 private:
@@ -33,11 +40,45 @@ public:
 
   auto is_done() -> bool;
 
+  /**
+   * @brief Whether no read, write-back or buffered write is in progress, so
+   * that run_once() only advances the clock
+   *
+   */
+  auto is_idle() -> bool;
+
   auto run_once() -> void;
 
   auto write_back(uint32_t address) -> bool;
 
   auto read_data(uint32_t address) -> bool;
 
+  /**
+   * @brief Awaitable write_back() of `address`, which a task only checks
+   * again in the cycle it completes
+   *
+   * @param address
+   */
+  auto await_write_back(uint32_t address) {
+    return until(
+        [this, address](int32_t) { return write_back(address); },
+        [this] { return std::max(pending_write_back.value_or(0), 1); });
+  }
+
+  /**
+   * @brief Awaitable read_data() of `address`, which a task only checks
+   * again in the cycle it completes
+   *
+   * @param address
+   */
+  auto await_read_data(uint32_t address) {
+    return until(
+        [this, address](int32_t) { return read_data(address); },
+        [this] { return std::max(pending_data_read.value_or(0), 1); });
+  }
+
   auto set_delay(int delay) -> void;
+
+  void save(CheckpointWriter &writer) const;
+  void restore(CheckpointReader &reader);
 };
\ No newline at end of file
@@ -3,4 +3,16 @@
 static const std::vector<std::string> SUPPORTED_PROTOCOLS = {"MESI", "Dragon",
                                                              "MOESI", "MESIF"};
 
+// Protocol argument that selects every supported protocol
+static const std::string ALL_PROTOCOLS = "all";
+
+/**
+ * @brief Parse a protocol argument: a supported protocol, a comma-separated
+ * list of them, or "all". Throws if a name is not supported.
+ *
+ * @param value
+ * @return std::vector<std::string>
+ */
+auto parse_protocols(const std::string &value) -> std::vector<std::string>;
+
 auto parser() -> argparse::ArgumentParser;
\ No newline at end of file
@@ -1,81 +1,311 @@
 #pragma once
 #include "bus.hpp"
 #include "cache_controller.hpp"
+#include "checkpoint.hpp"
 #include "statistics.hpp"
 #include "trace.hpp"
+#include "trace_source.hpp"
 
+#include <algorithm>
 #include <cstdint>
 #include <iostream>
 #include <memory>
 #include <numeric>
 #include <optional>
 #include <sstream>
+#include <vector>
 
-template <typename Protocol> class Processor {
+// Geometry is that of the cache, see FixedGeometry
+template <typename Protocol, typename Geometry = RuntimeGeometry>
+class Processor {
   int processor_id = 0;
-  int curr_idx = -1;
   std::optional<Instruction> curr_instr;
 
-  std::vector<Instruction> instruction_queue;
+  std::unique_ptr<TraceSource> trace_source;
   std::shared_ptr<CacheController<Protocol>> cache_controller;
   std::shared_ptr<StatisticsAccumulator> stats_accum;
 
+  // Instructions fetched so far, by type
+  uint64_t num_loads = 0;
+  uint64_t num_stores = 0;
+  uint64_t num_computes = 0;
+
+  // Instructions consumed by warm-up, which are not part of the statistics
+  uint64_t num_warmed_up = 0;
+
+  // While sampling, fetching stops once this many loads and stores have been
+  // fetched in detail
+  std::optional<uint64_t> access_limit;
+
+  // Instructions read from the trace by local_horizon() but not fetched yet,
+  // from lookahead_begin on. Unlike a deque, which frees and allocates a
+  // block every dozen instructions read ahead, the buffer is reused
+  std::vector<Instruction> lookahead;
+  size_t lookahead_begin = 0;
+
+  auto has_next() const -> bool {
+    return lookahead_begin < lookahead.size() || !trace_source->is_empty();
+  }
+
+  auto decode(const Instruction &instr) const -> ParsedAddress {
+    return cache_controller->template decode<Geometry>(instr);
+  }
+
+  auto fetch() -> Instruction {
+    if (lookahead_begin == lookahead.size()) {
+      return trace_source->next();
+    }
+    auto instr = lookahead[lookahead_begin++];
+    if (lookahead_begin == lookahead.size()) {
+      lookahead.clear();
+      lookahead_begin = 0;
+    }
+    return instr;
+  }
+
 public:
-  Processor(int processor_id, const std::vector<Instruction> &instruction_queue,
+  Processor(int processor_id, std::unique_ptr<TraceSource> trace_source,
             std::shared_ptr<CacheController<Protocol>> cache_controller,
             std::shared_ptr<StatisticsAccumulator> stats_accum)
-      : processor_id(processor_id), instruction_queue(instruction_queue),
+      : processor_id(processor_id), trace_source(std::move(trace_source)),
         cache_controller(cache_controller), stats_accum(stats_accum){};
 
-  auto progress() -> float {
-    return curr_idx / static_cast<float>(instruction_queue.size()) * 100.0f;
+  auto get_processor_id() -> int { return processor_id; }
+
+  auto is_done() -> bool { return !curr_instr && !has_next(); }
+
+  /**
+   * @brief Whether the core has retired everything up to its access limit
+   *
+   */
+  auto is_stalled() const -> bool {
+    return !curr_instr && access_limit &&
+           num_loads + num_stores >= access_limit.value();
   }
 
-  auto get_processor_id() -> int { return processor_id; }
+  /**
+   * @brief Whether every fetched instruction has retired
+   *
+   */
+  auto is_between_instructions() const -> bool { return !curr_instr; }
+
+  /**
+   * @brief Make room for looking `max_cycles` ahead with local_horizon().
+   * Every instruction takes a cycle at least, so once the fetched ones are
+   * dropped, the look-ahead buffer never grows beyond this.
+   *
+   * @param max_cycles
+   */
+  void reserve_lookahead(int64_t max_cycles) {
+    lookahead.reserve(static_cast<size_t>(max_cycles));
+  }
+
+  void set_access_limit(std::optional<uint64_t> limit) {
+    access_limit = limit;
+  }
+
+  auto num_accesses() const -> uint64_t { return num_loads + num_stores; }
+
+  /**
+   * @brief Instructions consumed so far, functionally or in detail
+   *
+   */
+  auto num_instructions() const -> uint64_t {
+    return num_warmed_up + num_loads + num_stores + num_computes;
+  }
+
+  /**
+   * @brief Execute the next memory access of the trace functionally,
+   * skipping compute instructions. Returns false if the trace has no access
+   * left
+   *
+   * @param stamp LRU stamp of the access
+   * @return bool
+   */
+  auto functional_step(int32_t stamp) -> bool {
+    while (has_next()) {
+      const auto instr = fetch();
+      num_warmed_up++;
+      if (instr.label != InstructionType::OTHER) {
+        cache_controller->template functional_access<Geometry>(
+            instr.label, decode(instr), stamp);
+        return true;
+      }
+    }
+    return false;
+  }
 
-  auto is_done() -> bool {
-    return curr_idx >= static_cast<int>(instruction_queue.size() - 1) &&
-           !curr_instr;
+  /**
+   * @brief Report the number of loads, stores and computes fetched so far
+   *
+   */
+  void register_instruction_counts() {
+    stats_accum->register_num_loads(processor_id, num_loads);
+    stats_accum->register_num_stores(processor_id, num_stores);
+    stats_accum->register_num_computes(processor_id, num_computes);
+  }
+
+  /**
+   * @brief Save the in-flight instruction and the trace position. The trace
+   * itself is not saved; restore() skips the instructions already fetched.
+   *
+   */
+  void save(CheckpointWriter &writer) const {
+    writer.write(curr_instr.has_value());
+    if (curr_instr) {
+      writer.write(curr_instr->label);
+      writer.write(curr_instr->num_cycles);
+      writer.write(curr_instr->address);
+    }
+    writer.write(num_loads);
+    writer.write(num_stores);
+    writer.write(num_computes);
+    writer.write(num_warmed_up);
   }
 
-  auto get_interesting_cache_lines() {
-    cache_controller->get_interesting_cache_lines();
+  void restore(CheckpointReader &reader) {
+    auto has_curr_instr = false;
+    reader.read(has_curr_instr);
+    curr_instr = std::nullopt;
+    if (has_curr_instr) {
+      auto label = InstructionType::OTHER;
+      auto num_cycles = std::optional<int>{};
+      auto address = std::optional<int>{};
+      reader.read(label);
+      reader.read(num_cycles);
+      reader.read(address);
+      curr_instr = Instruction{label, num_cycles, address};
+    }
+    reader.read(num_loads);
+    reader.read(num_stores);
+    reader.read(num_computes);
+    reader.read(num_warmed_up);
+    lookahead.clear();
+    lookahead_begin = 0;
+    if (trace_source->skip(num_instructions()) != num_instructions()) {
+      std::cerr << "Checkpoint is past the end of core " << processor_id
+                << "'s trace!" << std::endl;
+      std::exit(1);
+    }
   }
 
-  auto run_once(int32_t curr_cycle) -> std::optional<Instruction> {
+  /**
+   * @brief Number of cycles from the next one on, up to `max_cycles`, that
+   * the core will spend on computes and read hits only, which need neither
+   * the bus nor another cache. Reads the trace ahead but changes no state
+   * that the simulation can observe.
+   *
+   * With `bus_cycles`, write hits in a private state count as well: they
+   * hold the bus for their own cycle only, whose offset from the next one
+   * (1-based) is appended so that the caller can rule out two cores
+   * arbitrating in the same cycle.
+   *
+   * @param max_cycles
+   * @param bus_cycles Optional offsets of the private write hits
+   * @return int64_t
+   */
+  auto local_horizon(int64_t max_cycles,
+                     std::vector<int64_t> *bus_cycles = nullptr) -> int64_t {
     if (is_done()) {
-      return std::nullopt;
+      return max_cycles;
+    }
+    auto num_cycles = int64_t{0};
+    if (curr_instr) {
+      if (curr_instr->label != InstructionType::OTHER) {
+        return 0;
+      }
+      num_cycles += std::max(curr_instr->num_cycles.value(), 1);
+    }
+
+    for (size_t i = 0; num_cycles < max_cycles; i++) {
+      if (lookahead_begin + i == lookahead.size()) {
+        if (trace_source->is_empty()) {
+          // The simulation may stop once the core is done
+          return std::min(num_cycles, max_cycles);
+        }
+        if (lookahead.size() == lookahead.capacity() && lookahead_begin > 0) {
+          // Make room by dropping the fetched instructions
+          lookahead.erase(lookahead.begin(),
+                          lookahead.begin() +
+                              static_cast<std::ptrdiff_t>(lookahead_begin));
+          lookahead_begin = 0;
+        }
+        lookahead.push_back(trace_source->next());
+      }
+      const auto &instr = lookahead[lookahead_begin + i];
+      if (instr.label == InstructionType::OTHER) {
+        num_cycles += std::max(instr.num_cycles.value(), 1);
+      } else if (instr.label == InstructionType::READ &&
+                 cache_controller->template has_valid_line<Geometry>(
+                     decode(instr))) {
+        num_cycles += 1;
+      } else if (bus_cycles && instr.label == InstructionType::WRITE &&
+                 cache_controller->template has_private_line<Geometry>(
+                     decode(instr))) {
+        num_cycles += 1;
+        bus_cycles->push_back(num_cycles);
+      } else {
+        return num_cycles;
+      }
+    }
+    return std::min(num_cycles, max_cycles);
+  }
+
+  auto get_interesting_cache_lines(std::ostream &os = std::cout) {
+    cache_controller->get_interesting_cache_lines(os);
+  }
+
+  void run_once(int32_t curr_cycle) {
+    if (is_done() || is_stalled()) {
+      return;
     }
 
     // Fetch instruction
     if (!curr_instr) {
-      curr_idx += 1;
-      curr_instr = instruction_queue.at(curr_idx);
+      curr_instr = fetch();
+      switch (curr_instr->label) {
+      case InstructionType::READ:
+        num_loads++;
+        break;
+      case InstructionType::WRITE:
+        num_stores++;
+        break;
+      case InstructionType::OTHER:
+        num_computes++;
+        break;
+      }
     }
 
-    auto [label, cycles_left, address] = curr_instr.value();
+    const auto label = curr_instr->label;
 
     switch (label) {
     case InstructionType::OTHER: {
-      if (cycles_left > 1) {
+      if (curr_instr->num_cycles.value() > 1) {
         curr_instr->num_cycles = curr_instr->num_cycles.value() - 1;
       } else {
         // Instruction is completed -> retire instruction
         curr_instr = std::nullopt;
       }
       stats_accum->on_compute(get_processor_id());
-      return curr_instr;
+      break;
     }
     default: {
-      auto instr = cache_controller->processor_request(label, address.value(),
-                                                       curr_cycle);
-      if (instr.label == InstructionType::OTHER &&
-          instr.num_cycles.value() == 0) {
-        curr_instr = std::nullopt;
-      } else {
-        curr_instr = instr;
+      // Decoded once rather than on every cycle the access takes
+      if (!curr_instr->parsed_address) {
+        curr_instr->parsed_address = decode(curr_instr.value());
+      }
+      auto instr = cache_controller->template processor_request<Geometry>(
+          label, curr_instr->parsed_address.value(), curr_cycle);
+      // Until the access completes, the same request is made every cycle
+      if (instr) {
+        if (instr->label == InstructionType::OTHER &&
+            instr->num_cycles.value() == 0) {
+          curr_instr = std::nullopt;
+        } else {
+          curr_instr = instr;
+        }
       }
-      return curr_instr;
+      break;
     }
     }
   }
@@ -4,5 +4,38 @@
 
 enum class DragonStatus { E = 3, Sm = 2, Sc = 1, M = 4, I = 0 };
 auto to_string(const DragonStatus &status) -> std::string;
+template <> inline constexpr int num_states<DragonStatus> = 5;
 
 using DragonProtocol = Protocol<DragonStatus>;
+
+template <>
+inline auto DragonProtocol::handle_read_hit(int controller_id, int32_t,
+                                            ParsedAddress parsed_address,
+                                            CacheLine<Status> *,
+                                            const Context &context)
+    -> Instruction {
+  // Optimisation: allow read hits to be processed without acquiring the bus
+  return Instruction{InstructionType::OTHER, 0, std::nullopt};
+}
+
+template <>
+inline auto DragonProtocol::handle_local_write_hit(int controller_id,
+                                                   int32_t curr_cycle,
+                                                   ParsedAddress parsed_address,
+                                                   CacheLine<Status> *line,
+                                                   const Context &context)
+    -> std::optional<Instruction> {
+  switch (line->status) {
+  case DragonStatus::M: {
+    context.bus->release(controller_id);
+    return Instruction{InstructionType::OTHER, 0, std::nullopt};
+  }
+  case DragonStatus::E: {
+    line->status = DragonStatus::M;
+    context.bus->release(controller_id);
+    return Instruction{InstructionType::OTHER, 0, std::nullopt};
+  }
+  default:
+    return std::nullopt;
+  }
+}
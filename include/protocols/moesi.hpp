@@ -10,5 +10,59 @@ enum class MOESIStatus {
   I = 0 // default
 };
 auto to_string(const MOESIStatus &status) -> std::string;
+template <> inline constexpr int num_states<MOESIStatus> = 5;
 
 using MOESIProtocol = Protocol<MOESIStatus>;
+
+template <>
+inline auto MOESIProtocol::handle_read_hit(int controller_id,
+                                           int32_t curr_cycle,
+                                           ParsedAddress parsed_address,
+                                           CacheLine<Status> *line,
+                                           const Context &context)
+    -> Instruction {
+
+#ifdef DEBUG_FLAG
+  std::stringstream ss;
+  ss << "Cycle: " << curr_cycle << "\n"
+     << "Processor " << controller_id << " requests READ HIT at address "
+     << parsed_address.address << "\n\tLine: " << to_string(*line) << "\n\t>>> "
+     << to_string(*line) << std::endl;
+  std::cout << ss.str();
+#endif
+
+  // Optimisation: allow read hits to be processed without acquiring the bus
+  return Instruction{InstructionType::OTHER, 0, std::nullopt};
+}
+
+template <>
+inline auto MOESIProtocol::handle_local_write_hit(int controller_id,
+                                                  int32_t curr_cycle,
+                                                  ParsedAddress parsed_address,
+                                                  CacheLine<Status> *line,
+                                                  const Context &context)
+    -> std::optional<Instruction> {
+
+#ifdef DEBUG_FLAG
+  std::stringstream ss;
+  ss << "Cycle: " << curr_cycle << "\n"
+     << "Processor " << controller_id << " requests WRITE HIT at address "
+     << parsed_address.address << "\n\tLine: " << to_string(*line) << "\n\t>>> "
+     << to_string(*line) << std::endl;
+  std::cout << ss.str();
+#endif
+
+  switch (line->status) {
+  case MOESIStatus::M: {
+    context.bus->release(controller_id);
+    return Instruction{InstructionType::OTHER, 0, std::nullopt};
+  }
+  case MOESIStatus::E: {
+    context.bus->release(controller_id);
+    line->status = MOESIStatus::M;
+    return Instruction{InstructionType::OTHER, 0, std::nullopt};
+  }
+  default:
+    return std::nullopt;
+  }
+}
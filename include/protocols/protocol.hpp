@@ -5,6 +5,7 @@
 #include "cache_controller.hpp"
 #include "memory_controller.hpp"
 #include "statistics.hpp"
+#include "task.hpp"
 #include "trace.hpp"
 
 #include <array>
@@ -13,52 +14,115 @@
 #include <optional>
 #include <vector>
 
+/**
+ * @brief Classify the invalidation/update of a valid line caused by another
+ * cache's write and record it. The write is migratory if the writer already
+ * held the line (upgrade) and the word it writes was last written here; it is
+ * true sharing if this cache touched the word otherwise, and false sharing if
+ * this cache only touched other words of the line.
+ *
+ * @param request
+ * @param num_words_per_line
+ * @param line
+ * @param stats_accum
+ */
+template <typename Status>
+void record_sharing(const BusRequest &request, int32_t num_words_per_line,
+                    const CacheLine<Status> &line,
+                    StatisticsAccumulator &stats_accum) {
+  const auto block_size =
+      static_cast<uint32_t>(num_words_per_line * (WORD_SIZE >> 3));
+  const auto written_word = word_mask(request.address & (block_size - 1));
+  const auto is_upgrade = request.type == BusRequestType::BusInvalidate ||
+                          request.type == BusRequestType::BusUpd;
+
+  auto kind = SharingKind::FalseSharing;
+  if (is_upgrade && (line.written_words & written_word)) {
+    kind = SharingKind::Migratory;
+  } else if (line.touched_words & written_word) {
+    kind = SharingKind::TrueSharing;
+  }
+  stats_accum.on_sharing(request.address & ~(block_size - 1), kind);
+}
+
 template <typename ProtocolStatus> class Protocol {
+  static_assert(num_states<ProtocolStatus> > 0 &&
+                    num_states<ProtocolStatus> <= MAX_NUM_STATES,
+                "Status enum must specialise num_states and fit in "
+                "StatisticsAccumulator's per-state counters");
+
 private:
   static auto state_transition(const BusRequest &request,
-                               std::shared_ptr<CacheLine<ProtocolStatus>> line)
-      -> void;
+                               CacheLine<ProtocolStatus> *line) -> void;
 
 public:
   using Status = ProtocolStatus;
-  static auto handle_read_miss(
-      int controller_id, int32_t curr_cycle, ParsedAddress parsed_address,
-      std::vector<std::shared_ptr<CacheController<Protocol<Status>>>>
-          &cache_controllers,
-      std::shared_ptr<Bus> bus, std::shared_ptr<CacheLine<Status>> line,
-      std::shared_ptr<MemoryController> memory_controller,
-      std::shared_ptr<StatisticsAccumulator> stats_accum) -> Instruction;
+  using Context = SystemContext<Protocol<Status>>;
+
+  // Accesses that need the bus are tasks, started once the controller has
+  // acquired it. They co_await the write-back of the victim, the other
+  // caches' responses and memory as needed, and release the bus when done
+  static auto handle_read_miss(int controller_id, int32_t curr_cycle,
+                               ParsedAddress parsed_address,
+                               CacheLine<Status> *line, const Context &context)
+      -> Task;
+
+  static auto handle_write_miss(int controller_id, int32_t curr_cycle,
+                                ParsedAddress parsed_address,
+                                CacheLine<Status> *line,
+                                const Context &context) -> Task;
+
+  // The hit paths are defined in the protocol headers, so that they can be
+  // inlined into the cache controller
+  static auto handle_read_hit(int controller_id, int32_t, ParsedAddress,
+                              CacheLine<Status> *line, const Context &context)
+      -> Instruction;
 
-  static auto handle_write_miss(
-      int controller_id, int32_t curr_cycle, ParsedAddress parsed_address,
-      std::vector<std::shared_ptr<CacheController<Protocol<Status>>>>
-          &cache_controllers,
-      std::shared_ptr<Bus> bus, std::shared_ptr<CacheLine<Status>> line,
-      std::shared_ptr<MemoryController> memory_controller,
-      std::shared_ptr<StatisticsAccumulator> stats_accum) -> Instruction;
+  /**
+   * @brief Complete a write hit that needs no bus transaction, e.g. in M or
+   * E, in the cycle it has the bus. Returns nullopt if the state of `line`
+   * needs one, which handle_write_hit() then performs.
+   *
+   */
+  static auto handle_local_write_hit(int controller_id, int32_t curr_cycle,
+                                     ParsedAddress parsed_address,
+                                     CacheLine<Status> *line,
+                                     const Context &context)
+      -> std::optional<Instruction>;
 
-  static auto handle_read_hit(
-      int controller_id, int32_t, ParsedAddress,
-      std::vector<std::shared_ptr<CacheController<Protocol<Status>>>> &,
-      std::shared_ptr<Bus>, std::shared_ptr<CacheLine<Status>>,
-      std::shared_ptr<MemoryController>,
-      std::shared_ptr<StatisticsAccumulator> stats_accum) -> Instruction;
+  static auto handle_write_hit(int controller_id, int32_t curr_cycle,
+                               ParsedAddress parsed_address,
+                               CacheLine<Status> *line, const Context &context)
+      -> Task;
 
-  static auto handle_write_hit(
-      int controller_id, int32_t curr_cycle, ParsedAddress parsed_address,
-      std::vector<std::shared_ptr<CacheController<Protocol<Status>>>>
-          &cache_controllers,
-      std::shared_ptr<Bus> bus, std::shared_ptr<CacheLine<Status>> line,
-      std::shared_ptr<MemoryController> memory_controller,
-      std::shared_ptr<StatisticsAccumulator> stats_accum) -> Instruction;
+  /**
+   * @brief Snoop `request`. A cache-to-cache transfer is started by
+   * emplacing it in `pending_bus_request` with the number of cycles it
+   * takes; the cache is snooped again once that many cycles have passed, and
+   * the handler then completes the transfer and resets the slot.
+   *
+   */
+  static void handle_bus_request(
+      const BusRequest &request, int32_t controller_id,
+      std::optional<std::tuple<BusRequest, int32_t>> &pending_bus_request,
+      bool is_hit, int32_t num_words_per_line, CacheLine<Status> *line,
+      const Context &context);
 
-  static auto handle_bus_request(
-      const BusRequest &request, std::shared_ptr<Bus> bus,
-      int32_t controller_id,
-      std::shared_ptr<std::tuple<BusRequest, int32_t>> pending_bus_request,
-      bool is_hit, int32_t num_words_per_line,
-      std::shared_ptr<CacheLine<Status>> line,
-      std::shared_ptr<MemoryController> memory_controller,
-      std::shared_ptr<StatisticsAccumulator> stats_accum)
-      -> std::shared_ptr<std::tuple<BusRequest, int32_t>>;
+  /**
+   * @brief Apply the end state of an access in zero time, without the bus,
+   * memory or statistics: the line the request completes into and every
+   * valid copy of the block held by another cache (`sharers`) take the
+   * states and LRU stamps the timed handlers above would leave them in.
+   *
+   * @param instr_type READ or WRITE
+   * @param tag
+   * @param stamp LRU stamp of the access
+   * @param is_hit
+   * @param line The hit line, or the victim on a miss
+   * @param sharers
+   */
+  static void
+  handle_functional_access(InstructionType instr_type, uint32_t tag,
+                           int32_t stamp, bool is_hit, CacheLine<Status> &line,
+                           const std::vector<CacheLine<Status> *> &sharers);
 };
\ No newline at end of file
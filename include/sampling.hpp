@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+/**
+ * @brief Systematic sampling: every `interval` memory accesses of each core,
+ * the last `window` accesses are simulated in detail and measured, after
+ * `warmup` accesses simulated in detail but not measured, and the rest only
+ * functionally.
+ *
+ */
+struct SamplingConfig {
+  uint64_t interval;
+  uint64_t window;
+  uint64_t warmup;
+};
+
+/**
+ * @brief What one detailed window measured, as deltas over the window
+ *
+ */
+struct SampleWindow {
+  std::vector<int> cycles;            // Per core, until its last retire
+  std::vector<uint64_t> instructions; // Per core
+  uint64_t accesses = 0;              // Loads and stores, all cores
+  uint64_t hits = 0;                  // Read and write hits, all cores
+  uint64_t bus_traffic = 0;           // In words, all cores
+};
+
+/**
+ * @brief Sample mean and the half-width of its 95% confidence interval
+ *
+ */
+struct Estimate {
+  double mean = 0;
+  double half_width = 0;
+};
+
+/**
+ * @brief Estimate of the mean of a sample, using Student's t distribution
+ * for small samples
+ *
+ * @param values
+ * @return Estimate
+ */
+auto estimate_mean(const std::vector<double> &values) -> Estimate;
+
+/**
+ * @brief Collects the detailed windows of a sampled run and extrapolates
+ * them to the whole trace
+ *
+ */
+class SamplingEstimator {
+private:
+  const int num_cores;
+  const SamplingConfig config;
+
+  // One value per window: cycles per instruction of each core (cores with an
+  // exhausted trace contribute nothing), hit rate and bus words per
+  // instruction of the whole system
+  std::vector<std::vector<double>> cycles_per_instruction;
+  std::vector<double> hit_rates;
+  std::vector<double> bus_traffic_per_instruction;
+
+  std::vector<uint64_t> total_instructions;
+  uint64_t num_detailed_instructions = 0;
+
+public:
+  SamplingEstimator(int num_cores, const SamplingConfig &config);
+
+  void add_window(const SampleWindow &window);
+
+  /**
+   * @brief Register the length of a core's trace, once it has been consumed
+   *
+   * @param processor_id
+   * @param num_instructions
+   */
+  void register_total_instructions(int processor_id,
+                                   uint64_t num_instructions);
+
+  auto num_windows() const -> size_t { return hit_rates.size(); }
+
+  friend auto operator<<(std::ostream &os, const SamplingEstimator &p)
+      -> std::ostream &;
+};
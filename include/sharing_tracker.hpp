@@ -0,0 +1,44 @@
+#pragma once
+
+#include "checkpoint.hpp"
+#include "heavy_hitters.hpp"
+
+#include <array>
+#include <cstdint>
+#include <iostream>
+
+static constexpr auto NUM_TOP_SHARED_LINES = 10;
+static_assert(NUM_TOP_SHARED_LINES <= NUM_HEAVY_HITTERS);
+
+enum class SharingKind {
+  TrueSharing = 0,  // The invalidated copy had touched the written word
+  FalseSharing = 1, // The invalidated copy only touched other words
+  Migratory = 2,    // Read-modify-write hand-off between cores
+};
+static constexpr auto NUM_SHARING_KINDS = 3;
+auto to_string(const SharingKind &kind) -> std::string;
+
+/**
+ * @brief Counts classified invalidations/updates exactly in total, and ranks
+ * the lines that cause the most of them in fixed memory with Space-Saving.
+ *
+ */
+class SharingTracker {
+private:
+  using Counts = std::array<uint64_t, NUM_SHARING_KINDS>;
+
+  Counts totals{};
+  SpaceSaving top_lines;
+  // Events of each kind since the line in the same slot of top_lines was
+  // last taken over, so lower bounds
+  std::array<Counts, NUM_HEAVY_HITTERS> top_line_kinds{};
+
+public:
+  void record(uint32_t line_address, SharingKind kind);
+
+  void save(CheckpointWriter &writer) const;
+  void restore(CheckpointReader &reader);
+
+  friend auto operator<<(std::ostream &os, const SharingTracker &p)
+      -> std::ostream &;
+};
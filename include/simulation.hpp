@@ -0,0 +1,742 @@
+#pragma once
+#include "bus.hpp"
+#include "cache_controller.hpp"
+#include "checkpoint.hpp"
+#include "interval_recorder.hpp"
+#include "memory_controller.hpp"
+#include "processor.hpp"
+#include "sampling.hpp"
+#include "statistics.hpp"
+#include "trace.hpp"
+#include "trace_source.hpp"
+
+#include "protocols/dragon.hpp"
+#include "protocols/mesi.hpp"
+#include "protocols/mesif.hpp"
+#include "protocols/moesi.hpp"
+
+#include <algorithm>
+#include <array>
+#include <barrier>
+#include <cstdint>
+#include <filesystem>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Longest stretch of cycles the parallel engine runs between two
+// synchronisations, and the shortest one worth synchronising for
+static constexpr auto PARALLEL_QUANTUM = int64_t{4096};
+static constexpr auto MIN_PARALLEL_CYCLES = int64_t{64};
+// Shortest stretch of local cycles that the serial engine runs core by core
+static constexpr auto MIN_BATCH_CYCLES = int64_t{2};
+// Cycles are 32-bit in the components (LRU stamps, bus and task timestamps),
+// which only ever add a transfer's length to the current cycle. A run stops
+// with an error rather than simulate past this one.
+static constexpr auto MAX_SIMULATED_CYCLE = INT32_MAX - (1 << 16);
+
+struct SystemConfig {
+  int cache_size;
+  int associativity;
+  int block_size;
+};
+
+/**
+ * @brief State ids that the statistics treat as private (exclusive) and
+ * public (shared) for each protocol
+ *
+ */
+template <typename Protocol> auto private_states() -> std::vector<int>;
+template <typename Protocol> auto public_states() -> std::vector<int>;
+
+template <> inline auto private_states<MESIProtocol>() -> std::vector<int> {
+  return {static_cast<int>(MESIStatus::M), static_cast<int>(MESIStatus::E)};
+}
+template <> inline auto public_states<MESIProtocol>() -> std::vector<int> {
+  return {static_cast<int>(MESIStatus::S)};
+}
+
+template <> inline auto private_states<DragonProtocol>() -> std::vector<int> {
+  return {static_cast<int>(DragonStatus::M), static_cast<int>(DragonStatus::E)};
+}
+template <> inline auto public_states<DragonProtocol>() -> std::vector<int> {
+  return {static_cast<int>(DragonStatus::Sm),
+          static_cast<int>(DragonStatus::Sc)};
+}
+
+template <> inline auto private_states<MOESIProtocol>() -> std::vector<int> {
+  return {static_cast<int>(MOESIStatus::M), static_cast<int>(MOESIStatus::E)};
+}
+template <> inline auto public_states<MOESIProtocol>() -> std::vector<int> {
+  return {static_cast<int>(MOESIStatus::O), static_cast<int>(MOESIStatus::S)};
+}
+
+template <> inline auto private_states<MESIFProtocol>() -> std::vector<int> {
+  return {static_cast<int>(MESIFStatus::M), static_cast<int>(MESIFStatus::E)};
+}
+template <> inline auto public_states<MESIFProtocol>() -> std::vector<int> {
+  return {static_cast<int>(MESIFStatus::S), static_cast<int>(MESIFStatus::F)};
+}
+
+template <typename Protocol>
+auto make_statistics_accumulator(int block_size)
+    -> std::shared_ptr<StatisticsAccumulator> {
+  auto stats_accum = std::make_shared<StatisticsAccumulator>(
+      NUM_CORES, private_states<Protocol>(), public_states<Protocol>());
+  stats_accum->register_block_size(block_size);
+  return stats_accum;
+}
+
+/**
+ * @brief The simulated machine: cores with private caches on a snooping bus,
+ * backed by one memory controller. The cores look their caches up with
+ * `Geometry`, which must match the configuration, see with_geometry().
+ *
+ */
+template <typename Protocol, typename Geometry = RuntimeGeometry>
+class System {
+public:
+  std::shared_ptr<StatisticsAccumulator> stats_accum;
+  std::shared_ptr<Bus> bus;
+  std::shared_ptr<MemoryController> memory_controller;
+  std::vector<std::shared_ptr<CacheController<Protocol>>> cache_controllers;
+  std::vector<std::shared_ptr<Processor<Protocol, Geometry>>> cores;
+
+  // Raw views of the components above, handed to the protocol handlers
+  SystemContext<Protocol> context;
+
+  // Last simulated cycle
+  int cycle = -1;
+
+private:
+  // Parallel engine, see set_num_threads()
+  std::vector<std::thread> workers;
+  std::unique_ptr<std::barrier<>> quantum_barrier;
+  std::vector<int64_t> horizons;
+  std::vector<int64_t> bus_cycles;
+  int64_t quantum_max_cycles = 0;
+  bool is_stopping = false;
+
+public:
+
+  System(const SystemConfig &config, TraceSources trace_sources,
+         std::shared_ptr<StatisticsAccumulator> stats_accum)
+      : stats_accum(stats_accum),
+        bus(std::make_shared<Bus>(NUM_CORES, stats_accum)),
+        memory_controller(std::make_shared<MemoryController>(stats_accum)) {
+    if (!Geometry::matches(config.cache_size, config.associativity,
+                           config.block_size)) {
+      std::cerr << "The system was compiled for another cache geometry!"
+                << std::endl;
+      std::exit(1);
+    }
+
+    cache_controllers.reserve(NUM_CORES);
+    for (int i = 0; i < NUM_CORES; i++) {
+      cache_controllers.emplace_back(
+          std::make_shared<CacheController<Protocol>>(
+              i, config.cache_size, config.associativity, config.block_size,
+              bus, memory_controller, stats_accum));
+    }
+    context.bus = bus.get();
+    context.memory_controller = memory_controller.get();
+    context.stats_accum = stats_accum.get();
+    for (auto &cache_controller : cache_controllers) {
+      context.cache_controllers.push_back(cache_controller.get());
+    }
+    for (auto &cache_controller : cache_controllers) {
+      cache_controller->register_context(context);
+    }
+
+    for (int i = 0; i < NUM_CORES; i++) {
+      cores.emplace_back(std::make_shared<Processor<Protocol, Geometry>>(
+          i, std::move(trace_sources.at(i)), cache_controllers.at(i),
+          stats_accum));
+    }
+    // So that looking ahead does not allocate while simulating
+    for (auto &core : cores) {
+      core->reserve_lookahead(PARALLEL_QUANTUM);
+    }
+    bus_cycles.reserve(NUM_CORES * PARALLEL_QUANTUM);
+
+    // Initialise memory controller delay
+    memory_controller->set_delay(
+        2 * cache_controllers.at(0)->cache.num_words_per_line);
+  }
+
+  System(const SystemConfig &config,
+         const std::array<std::vector<Instruction>, NUM_CORES> &traces,
+         std::shared_ptr<StatisticsAccumulator> stats_accum)
+      : System(config, make_vector_sources(traces), stats_accum) {}
+
+  System(const System &) = delete;
+  auto operator=(const System &) -> System & = delete;
+
+  ~System() { set_num_threads(1); }
+
+  auto is_done() const -> bool {
+    return std::all_of(cores.begin(), cores.end(),
+                       [](auto &core) { return core->is_done(); });
+  }
+
+  /**
+   * @brief Simulate the cores on up to `num_threads` threads (at most one
+   * per core and, unless `oversubscribe`, per hardware thread) from now on.
+   * Whenever the bus and the memory controller are idle, every core runs its
+   * computes and read hits on its own thread up to the cycle before the
+   * first bus access of any core; everything else is simulated serially. The
+   * results are identical to a single thread.
+   *
+   * @param num_threads
+   * @param oversubscribe
+   * @return The number of threads used
+   */
+  auto set_num_threads(int num_threads, bool oversubscribe = false) -> int {
+    if (!workers.empty()) {
+      is_stopping = true;
+      quantum_barrier->arrive_and_wait();
+      for (auto &worker : workers) {
+        worker.join();
+      }
+      workers.clear();
+      is_stopping = false;
+    }
+
+#ifdef DEBUG_FLAG
+    // The debug output of every cycle needs the serial engine
+    num_threads = 1;
+#endif
+    // Waiting workers spin for a while, so never use more than there are
+    // hardware threads unless told to
+    const auto num_hardware_threads =
+        std::max(std::thread::hardware_concurrency(), 1u);
+    const auto max_workers =
+        oversubscribe ? cores.size()
+                      : std::min<size_t>(cores.size(), num_hardware_threads);
+    const auto num_workers =
+        std::clamp<size_t>(static_cast<size_t>(num_threads), 1, max_workers);
+    if (num_workers == 1) {
+      quantum_barrier = nullptr;
+      return 1;
+    }
+
+    horizons.assign(cores.size(), 0);
+    quantum_barrier = std::make_unique<std::barrier<>>(num_workers);
+    for (size_t worker = 1; worker < num_workers; worker++) {
+      workers.emplace_back([this, worker] {
+        while (true) {
+          quantum_barrier->arrive_and_wait();
+          if (is_stopping) {
+            return;
+          }
+          run_quantum(worker);
+        }
+      });
+    }
+    return static_cast<int>(num_workers);
+  }
+
+  /**
+   * @brief Simulate one cycle of the memory controller, the bus and each core
+   *
+   */
+  void run_once() {
+    cycle++;
+    memory_controller->run_once();
+    bus->reset();
+
+    // Run each core once
+    for (auto &core : cores) {
+      core->run_once(cycle);
+      if (core->is_done()) {
+        stats_accum->on_run_end(core->get_processor_id(), cycle);
+      }
+    }
+
+#ifdef DEBUG_FLAG
+    // Print each cache's content
+    for (auto &cache_controller : cache_controllers) {
+      cache_controller->get_interesting_cache_lines();
+    }
+#endif
+  }
+
+  /**
+   * @brief Warm the caches up with the next `num_accesses` memory accesses
+   * of each core, interleaved round-robin, through the functional model. No
+   * cycles are simulated and nothing is counted in the statistics. Returns
+   * the number of accesses performed
+   *
+   * @param num_accesses Per core
+   * @return uint64_t
+   */
+  auto warm_up(uint64_t num_accesses) -> uint64_t {
+    // Stamps continue after the last simulated cycle, and are shifted back
+    // below the next one at the end (or whenever they would overflow)
+    const auto first_stamp = int64_t{cycle} + 1;
+    auto stamp = first_stamp;
+    auto num_warmed_up = uint64_t{0};
+    auto is_active = std::vector<bool>(cores.size(), true);
+    for (auto i = uint64_t{0}; i < num_accesses; i++) {
+      if (stamp > INT32_MAX - static_cast<int64_t>(cores.size())) {
+        shift_last_used(first_stamp - stamp);
+        stamp = first_stamp;
+      }
+      auto any_active = false;
+      for (size_t core = 0; core < cores.size(); core++) {
+        if (is_active.at(core)) {
+          is_active.at(core) = cores.at(core)->functional_step(stamp++);
+          num_warmed_up += is_active.at(core);
+          any_active |= is_active.at(core);
+        }
+      }
+      if (!any_active) {
+        break;
+      }
+    }
+
+    shift_last_used(first_stamp - stamp);
+    return num_warmed_up;
+  }
+
+  /**
+   * @brief Run until every core has retired its trace or `last_cycle` has
+   * been simulated, whichever comes first. Returns whether every core is done
+   *
+   * @param last_cycle
+   * @param interval_recorder Optional sampler of the statistics
+   * @return bool
+   */
+  auto run_until(int last_cycle, IntervalRecorder *interval_recorder = nullptr)
+      -> bool {
+#ifndef DEBUG_FLAG
+    // The is_quiet() and look-ahead check is skipped until this cycle, as
+    // the last one found too few local cycles for a parallel quantum or a
+    // batch, and no core reaches the bus before it
+    auto next_check_cycle = cycle;
+#endif
+    while (!is_done() && cycle < last_cycle) {
+      auto max_cycles =
+          std::min(PARALLEL_QUANTUM, int64_t{last_cycle} - cycle);
+      if (interval_recorder) {
+        max_cycles = std::min<int64_t>(
+            max_cycles, interval_recorder->cycles_until_due(cycle));
+      }
+
+      auto num_local_cycles = int64_t{0};
+#ifndef DEBUG_FLAG
+      // The debug output of every cycle needs the cycle-by-cycle engine
+      if (cycle >= next_check_cycle && is_quiet()) {
+        if (quantum_barrier) {
+          // The barriers only pay off if every core has enough local work
+          num_local_cycles = max_cycles;
+          for (auto &core : cores) {
+            num_local_cycles = std::min(
+                num_local_cycles, core->local_horizon(MIN_PARALLEL_CYCLES));
+          }
+        } else {
+          num_local_cycles = batch_horizon(max_cycles);
+        }
+        next_check_cycle = cycle + static_cast<int>(num_local_cycles);
+      }
+#endif
+
+      if (quantum_barrier &&
+          num_local_cycles >= std::min(max_cycles, MIN_PARALLEL_CYCLES)) {
+        quantum_max_cycles = max_cycles;
+        quantum_barrier->arrive_and_wait();
+        const auto num_cycles = run_quantum(0);
+        for (auto i = int64_t{0}; i < num_cycles; i++) {
+          memory_controller->run_once();
+        }
+        bus->reset();
+        cycle += static_cast<int>(num_cycles);
+      } else if (num_local_cycles >= MIN_BATCH_CYCLES) {
+        run_batch(num_local_cycles);
+      } else {
+        run_once();
+      }
+
+      if (interval_recorder && interval_recorder->is_due(cycle)) {
+        interval_recorder->record(cycle, *stats_accum);
+      }
+    }
+    return is_done();
+  }
+
+  /**
+   * @brief Run until `first_cycle` has been simulated, then on until no
+   * cache is in the middle of a bus transaction, whose task cannot be
+   * saved. Returns whether every core is done
+   *
+   * @param first_cycle
+   * @param interval_recorder Optional sampler of the statistics
+   * @return bool
+   */
+  auto run_until_checkpoint(int first_cycle,
+                            IntervalRecorder *interval_recorder = nullptr)
+      -> bool {
+    auto is_done = run_until(first_cycle, interval_recorder);
+    while (!is_done &&
+           std::any_of(cache_controllers.begin(), cache_controllers.end(),
+                       [](auto &cc) { return cc->is_in_transaction(); })) {
+      is_done = run_until(cycle + 1, interval_recorder);
+    }
+    return is_done;
+  }
+
+  /**
+   * @brief Run until every core has retired its trace. Returns the last
+   * simulated cycle
+   *
+   * @param interval_recorder Optional sampler of the statistics
+   * @return int
+   */
+  auto run(IntervalRecorder *interval_recorder = nullptr) -> int {
+    if (!run_until(MAX_SIMULATED_CYCLE, interval_recorder)) {
+      exit_at_cycle_limit();
+    }
+    if (interval_recorder) {
+      interval_recorder->close(cycle, *stats_accum);
+    }
+    for (auto &core : cores) {
+      core->register_instruction_counts();
+    }
+    return cycle;
+  }
+
+  /**
+   * @brief Run the rest of the traces as systematic samples: functional
+   * warm-up up to the last `config.warmup` + `config.window` accesses of
+   * every `config.interval`, which are simulated in detail, and only the
+   * last `config.window` measured. Returns the last simulated cycle
+   *
+   * @param config
+   * @param estimator Receives the measurement of every window
+   * @return int
+   */
+  auto run_sampled(const SamplingConfig &config, SamplingEstimator &estimator)
+      -> int {
+    while (!is_done()) {
+      warm_up(config.interval - config.warmup - config.window);
+      if (is_done()) {
+        break;
+      }
+      estimator.add_window(run_window(config.warmup, config.window));
+    }
+
+    for (auto &core : cores) {
+      core->register_instruction_counts();
+      estimator.register_total_instructions(core->get_processor_id(),
+                                            core->num_instructions());
+    }
+    return cycle;
+  }
+
+  /**
+   * @brief Save the state of every component, between two cycles
+   *
+   * @param writer
+   */
+  void save(CheckpointWriter &writer) const {
+    writer.write(cycle);
+    stats_accum->save(writer);
+    bus->save(writer);
+    memory_controller->save(writer);
+    for (const auto &cache_controller : cache_controllers) {
+      cache_controller->save(writer);
+    }
+    for (const auto &core : cores) {
+      core->save(writer);
+    }
+  }
+
+  /**
+   * @brief Restore a state saved by save() into a system built with the same
+   * configuration and traces
+   *
+   * @param reader
+   */
+  void restore(CheckpointReader &reader) {
+    reader.read(cycle);
+    stats_accum->restore(reader);
+    bus->restore(reader);
+    memory_controller->restore(reader);
+    for (auto &cache_controller : cache_controllers) {
+      cache_controller->restore(reader);
+    }
+    for (auto &core : cores) {
+      core->restore(reader);
+    }
+  }
+
+  void print_cache_content(std::ostream &os = std::cout) const {
+    for (auto &core : cores) {
+      core->get_interesting_cache_lines(os);
+    }
+  }
+
+private:
+  /**
+   * @brief Whether every cycle until the next bus access of a core only
+   * involves the cores and their own caches
+   *
+   */
+  auto is_quiet() -> bool {
+    return bus->is_idle() && memory_controller->is_idle() &&
+           std::none_of(cache_controllers.begin(), cache_controllers.end(),
+                        [](auto &cc) { return cc->has_pending_bus_request(); });
+  }
+
+  /**
+   * @brief The part of a parallel quantum run by one worker: find how far
+   * its cores can run locally, agree on the minimum with the other workers,
+   * then run its cores that far. Returns the number of cycles run
+   *
+   * @param worker
+   * @return int64_t
+   */
+  auto run_quantum(size_t worker) -> int64_t {
+    const auto num_workers = workers.size() + 1;
+    for (auto i = worker; i < cores.size(); i += num_workers) {
+      horizons.at(i) = cores.at(i)->local_horizon(quantum_max_cycles);
+    }
+    quantum_barrier->arrive_and_wait();
+
+    const auto num_cycles =
+        *std::min_element(horizons.begin(), horizons.end());
+    for (auto i = worker; i < cores.size(); i += num_workers) {
+      auto &core = cores.at(i);
+      for (auto t = cycle + 1; t <= cycle + num_cycles; t++) {
+        core->run_once(t);
+        if (core->is_done()) {
+          stats_accum->on_run_end(core->get_processor_id(), t);
+        }
+      }
+    }
+    quantum_barrier->arrive_and_wait();
+    return num_cycles;
+  }
+
+  /**
+   * @brief Number of cycles from the next one on, up to `max_cycles`, in
+   * which every core only computes or hits in its own cache, and no two
+   * cores take the bus for a private write hit in the same cycle
+   *
+   * @param max_cycles
+   * @return int64_t
+   */
+  auto batch_horizon(int64_t max_cycles) -> int64_t {
+    bus_cycles.clear();
+    auto num_cycles = max_cycles;
+    for (auto &core : cores) {
+      num_cycles =
+          std::min(num_cycles, core->local_horizon(num_cycles, &bus_cycles));
+    }
+
+    std::sort(bus_cycles.begin(), bus_cycles.end());
+    const auto clash = std::adjacent_find(bus_cycles.begin(), bus_cycles.end());
+    if (clash != bus_cycles.end()) {
+      // The second core to arbitrate in that cycle would have to wait
+      num_cycles = std::min(num_cycles, *clash - 1);
+    }
+    return num_cycles;
+  }
+
+  /**
+   * @brief Run each core in turn through the next `num_cycles` cycles, found
+   * local by batch_horizon(), then the memory controller. The results are
+   * those of as many calls to run_once()
+   *
+   * @param num_cycles
+   */
+  void run_batch(int64_t num_cycles) {
+    for (auto &core : cores) {
+      for (auto t = cycle + 1; t <= cycle + num_cycles; t++) {
+        // Nobody else takes the bus in this cycle
+        bus->reset();
+        core->run_once(t);
+        if (core->is_done()) {
+          stats_accum->on_run_end(core->get_processor_id(), t);
+        }
+      }
+    }
+    for (auto i = int64_t{0}; i < num_cycles; i++) {
+      memory_controller->run_once();
+    }
+    bus->reset();
+    cycle += static_cast<int>(num_cycles);
+  }
+
+  [[noreturn]] void exit_at_cycle_limit() const {
+    std::cerr << "The simulation reached cycle " << cycle << ", the most a run "
+              << "can simulate!" << std::endl;
+    std::exit(1);
+  }
+
+  void shift_last_used(int64_t offset) {
+    for (auto &cache_controller : cache_controllers) {
+      cache_controller->shift_last_used(offset);
+    }
+  }
+
+  /**
+   * @brief Simulate the next `num_warmup` + `num_accesses` memory accesses
+   * of each core in detail, and measure each core over the last
+   * `num_accesses` of them. Every core keeps running until all of them have
+   * been measured, so that each one is measured from and to a steady state
+   * of the bus, the memory controller and the other cores. Then the cores
+   * stop fetching, so that the window ends with no instruction in flight
+   *
+   * @param num_warmup Per core
+   * @param num_accesses Per core
+   * @return SampleWindow
+   */
+  auto run_window(uint64_t num_warmup, uint64_t num_accesses)
+      -> SampleWindow {
+    struct Mark {
+      int32_t cycle;
+      CoreCounters counters;
+      uint64_t accesses;
+      uint64_t instructions;
+    };
+    auto starts = std::vector<std::optional<Mark>>(cores.size());
+    auto ends = std::vector<std::optional<Mark>>(cores.size());
+    auto start_accesses = std::vector<uint64_t>{};
+    for (auto &core : cores) {
+      start_accesses.push_back(core->num_accesses());
+    }
+
+    // A core is marked once it has retired the given number of accesses, or
+    // has retired its whole trace
+    const auto mark = [&](std::vector<std::optional<Mark>> &marks,
+                          uint64_t num_accesses) {
+      for (size_t i = 0; i < cores.size(); i++) {
+        auto &core = cores.at(i);
+        if (!marks.at(i) &&
+            (core->is_done() ||
+             (core->num_accesses() >= start_accesses.at(i) + num_accesses &&
+              core->is_between_instructions()))) {
+          marks.at(i) = Mark{
+              cycle, stats_accum->get_core_counters(core->get_processor_id()),
+              core->num_accesses(), core->num_instructions()};
+        }
+      }
+    };
+    const auto run_one_cycle = [&] {
+      if (cycle >= MAX_SIMULATED_CYCLE) {
+        exit_at_cycle_limit();
+      }
+      run_once();
+    };
+
+    mark(starts, num_warmup);
+    mark(ends, num_warmup + num_accesses);
+    while (std::any_of(ends.begin(), ends.end(),
+                       [](auto &end) { return !end.has_value(); })) {
+      run_one_cycle();
+      mark(starts, num_warmup);
+      mark(ends, num_warmup + num_accesses);
+    }
+
+    for (auto &core : cores) {
+      core->set_access_limit(core->num_accesses());
+    }
+    while (!std::all_of(cores.begin(), cores.end(), [](auto &core) {
+      return core->is_done() || core->is_stalled();
+    })) {
+      run_one_cycle();
+    }
+
+    auto window = SampleWindow{};
+    for (size_t i = 0; i < cores.size(); i++) {
+      cores.at(i)->set_access_limit(std::nullopt);
+      // A core whose trace ended during the warm-up is started at its end
+      const auto &end = ends.at(i).value();
+      const auto &start = starts.at(i).value_or(end);
+      window.cycles.push_back(end.cycle - start.cycle);
+      window.instructions.push_back(end.instructions - start.instructions);
+      window.accesses += end.accesses - start.accesses;
+      window.hits += end.counters.read_hits - start.counters.read_hits +
+                     end.counters.write_hits - start.counters.write_hits;
+      window.bus_traffic +=
+          end.counters.bus_traffic - start.counters.bus_traffic;
+    }
+    return window;
+  }
+};
+
+/**
+ * @brief Call `f.template operator()<Geometry>()` with the first of
+ * `Geometry, Geometries...` that matches `config`, or else the last one
+ *
+ */
+template <typename Geometry, typename... Geometries, typename F>
+auto dispatch_geometry(const SystemConfig &config, F &&f) {
+  if constexpr (sizeof...(Geometries) > 0) {
+    if (!Geometry::matches(config.cache_size, config.associativity,
+                           config.block_size)) {
+      return dispatch_geometry<Geometries...>(config, std::forward<F>(f));
+    }
+  }
+  return f.template operator()<Geometry>();
+}
+
+/**
+ * @brief Call `f.template operator()<Geometry>()` with the geometry to
+ * simulate `config` with: a FixedGeometry for the configurations of the
+ * usual sweeps (4 KB caches of 1, 2 or 4 ways with 32 B blocks, and 2 ways
+ * with 64 B blocks), RuntimeGeometry for any other
+ *
+ * @param config
+ * @param f
+ */
+template <typename F> auto with_geometry(const SystemConfig &config, F &&f) {
+  return dispatch_geometry<FixedGeometry<64, 2, 32>, FixedGeometry<128, 1, 32>,
+                           FixedGeometry<32, 4, 32>, FixedGeometry<32, 2, 64>,
+                           RuntimeGeometry>(config, std::forward<F>(f));
+}
+
+/**
+ * @brief Write a checkpoint of a system, with a header describing the
+ * configuration and traces it was taken with
+ *
+ */
+template <typename Protocol, typename Geometry>
+void save_checkpoint(const std::filesystem::path &path,
+                     const std::string &protocol, const SystemConfig &config,
+                     const TraceIdentity &trace,
+                     const System<Protocol, Geometry> &system) {
+  auto writer = CheckpointWriter{};
+  writer.write(make_checkpoint_header(protocol, NUM_CORES, config.cache_size,
+                                      config.associativity, config.block_size,
+                                      system.cycle, trace));
+  system.save(writer);
+  writer.save(path);
+}
+
+/**
+ * @brief Restore a checkpoint into a freshly built system. Exits if the
+ * checkpoint was taken with a different configuration or traces.
+ *
+ */
+template <typename Protocol, typename Geometry>
+void restore_checkpoint(const std::filesystem::path &path,
+                        const std::string &protocol,
+                        const SystemConfig &config,
+                        const TraceIdentity &trace,
+                        System<Protocol, Geometry> &system) {
+  auto reader = CheckpointReader{path};
+  auto header = CheckpointHeader{};
+  reader.read(header);
+  check_checkpoint_header(header, protocol, NUM_CORES, config.cache_size,
+                          config.associativity, config.block_size, trace);
+  system.restore(reader);
+  if (!reader.is_at_end()) {
+    std::cerr << "Checkpoint " << path << " has trailing data!" << std::endl;
+    std::exit(1);
+  }
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "trace.hpp"
+
+#include <array>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+static constexpr auto PROFILE_MIN_CACHE_SIZE = 512;      // bytes
+static constexpr auto PROFILE_MAX_CACHE_SIZE = 1 << 20; // bytes
+static constexpr std::array<int, 5> PROFILE_ASSOCIATIVITIES = {1, 2, 4, 8, 16};
+
+/**
+ * @brief LRU stack-distance (Mattson) profiler.
+ *
+ * Walks each core's trace once per set count and records, for every access,
+ * the number of distinct lines of the same set touched since the previous
+ * access to that line. An access hits in an A-way LRU cache with that many
+ * sets iff its stack distance is < A, so a single run yields the miss-ratio
+ * curve of every (cache size, associativity) pair for the given block size.
+ * Distances are counted with a Fenwick tree over each set's access sequence,
+ * i.e. O(log n) per access and set count.
+ *
+ * Optionally, writes from other cores are folded in as invalidations: the
+ * per-core traces are merged by their local time (compute cycles plus one
+ * cycle per access), and a write removes the line from every other core's
+ * stack, so the next access to it there is a coherence miss.
+ *
+ */
+class StackDistanceProfiler {
+private:
+  const int num_offset_bits;
+  const int max_set_index_bits;
+  const bool fold_in_invalidations;
+
+  // Per core: encoded events (line id << 1 | is_invalidation)
+  std::array<std::vector<uint32_t>, NUM_CORES> events;
+  std::array<uint64_t, NUM_CORES> num_accesses{};
+  std::vector<uint32_t> line_addresses; // Indexed by line id
+
+  // distances[core][set_index_bits][d]: accesses with stack distance d
+  std::array<std::vector<std::vector<uint64_t>>, NUM_CORES> distances;
+  // Cold and coherence misses (infinite stack distance)
+  std::array<std::vector<uint64_t>, NUM_CORES> infinite_distances;
+
+  void
+  build_events(const std::array<std::vector<Instruction>, NUM_CORES> &traces);
+  void profile_core(int core, int set_index_bits);
+
+  auto num_misses(int core, int set_index_bits, int associativity) const
+      -> uint64_t;
+
+public:
+  StackDistanceProfiler(int block_size, bool fold_in_invalidations);
+
+  void profile(const std::array<std::vector<Instruction>, NUM_CORES> &traces);
+
+  /**
+   * @brief Miss ratio of an LRU cache of the given geometry, or a negative
+   * value if the geometry is outside the profiled range
+   *
+   */
+  auto miss_ratio(int core, int cache_size, int associativity) const -> double;
+
+  friend auto operator<<(std::ostream &os, const StackDistanceProfiler &p)
+      -> std::ostream &;
+};
@@ -1,44 +1,107 @@
 #pragma once
 
+#include "checkpoint.hpp"
+#include "heavy_hitters.hpp"
+#include "latency_histogram.hpp"
+#include "sharing_tracker.hpp"
+
+#include <array>
+#include <cstdint>
 #include <functional>
 #include <iostream>
-#include <map>
 #include <optional>
 #include <vector>
 
+// Upper bound on the number of states of any supported protocol. Each
+// protocol specialises `num_states` next to its Status enum, and
+// `Protocol<Status>` checks that it fits at compile time.
+static constexpr auto MAX_NUM_STATES = 5;
+
+template <typename Status> inline constexpr int num_states = 0;
+
+// Hit counters indexed by state id: [0] for reads, [1] for writes
+using StateCounters = std::array<std::array<int64_t, MAX_NUM_STATES>, 2>;
+
+/**
+ * @brief Cumulative per-core counters, as sampled by the interval recorder.
+ *
+ */
+struct CoreCounters {
+  int64_t read_hits = 0;
+  int64_t write_hits = 0;
+  int64_t misses = 0;
+  int64_t idles = 0;
+  int64_t bus_traffic = 0; // in words
+  int64_t invalidates = 0;
+};
+
+/**
+ * @brief Headline results of a run, for comparing protocols
+ *
+ */
+struct RunSummary {
+  int64_t execution_cycles = 0;
+  int64_t bus_traffic_bytes = 0;
+  int64_t write_backs = 0;
+};
+
+enum class LatencyKind {
+  MemoryMiss = 0,       // Miss served by main memory (or the write buffer)
+  CacheToCacheMiss = 1, // Miss served by another cache
+  Upgrade = 2,          // Write hit on a shared line (invalidation / update)
+  BusWait = 3,          // Cycles spent queueing in Bus::acquire
+};
+static constexpr auto NUM_LATENCY_KINDS = 4;
+auto to_string(const LatencyKind &kind) -> std::string;
+
 class StatisticsAccumulator {
 private:
   const std::vector<int> private_states;
   const std::vector<int> public_states;
 
-  std::vector<int> num_loads_instr;
-  std::vector<int> num_stores_instr;
-  std::vector<int> num_computes_instr;
+  std::vector<int64_t> num_loads_instr;
+  std::vector<int64_t> num_stores_instr;
+  std::vector<int64_t> num_computes_instr;
 
-  std::vector<int> num_read_hits;
-  std::vector<int> num_write_hits;
-  std::vector<int> num_computes;
+  std::vector<int64_t> num_read_hits;
+  std::vector<int64_t> num_write_hits;
+  std::vector<int64_t> num_computes;
 
-  std::vector<int> cycles_completion;
-  std::vector<int> cycles_others;
+  std::vector<int64_t> cycles_completion;
+  std::vector<int64_t> cycles_others;
 
-  std::vector<int> num_idles;
+  std::vector<int64_t> num_idles;
+  std::vector<int64_t> num_misses;
 
-  std::vector<int> num_invalidates;
+  std::vector<int64_t> num_invalidates;
 
-  std::vector<std::array<std::map<int, int>, 2>> cache_accesses;
+  std::vector<StateCounters> cache_accesses;
   std::optional<std::function<std::string(int)>> state_parser;
 
-  int num_write_backs;
-  int num_bus_traffic;
+  int64_t num_write_backs = 0;
+  int64_t num_bus_traffic = 0;
+  std::vector<int64_t> num_bus_traffic_per_core;
+
+  std::vector<std::array<LatencyHistogram, NUM_LATENCY_KINDS>> latencies;
+  std::vector<bool> is_cache_to_cache;
+  LatencyHistogram write_back_stalls;
+
+  SharingTracker sharing_tracker;
+
+  // Hot lines, keyed by line address
+  uint32_t line_address_mask = ~uint32_t{0};
+  HeavyHitterTracker hot_bus_lines;
+  HeavyHitterTracker hot_write_back_lines;
+  HeavyHitterTracker hot_invalidate_lines;
 
 public:
   StatisticsAccumulator(int num_cores, std::vector<int> private_states,
                         std::vector<int> public_states);
 
-  void register_num_loads(int processor_id, int num_loads);
-  void register_num_stores(int processor_id, int num_stores);
-  void register_num_computes(int processor_id, int num_computes);
+  void register_num_loads(int processor_id, int64_t num_loads);
+  void register_num_stores(int processor_id, int64_t num_stores);
+  void register_num_computes(int processor_id, int64_t num_computes);
+  void register_block_size(int block_size);
 
   void on_run_end(int processor_id, int cycle_count);
   void on_compute(int processor_id);
@@ -48,17 +111,52 @@ public:
 
   void on_idle(int processor_id, int cycle_count);
 
+  void on_miss(int processor_id, int cycle_count, int latency);
+
+  void on_upgrade(int processor_id, int latency);
+
+  /**
+   * @brief Mark the processor's outstanding miss as served by another cache
+   * rather than by memory
+   *
+   * @param processor_id
+   */
+  void on_cache_to_cache_transfer(int processor_id);
+
+  void on_bus_wait(int processor_id, int cycles);
+
+  void on_write_back_stall(int cycles);
+
+  auto is_private_state(int state_id) const -> bool;
+  auto is_public_state(int state_id) const -> bool;
+
   // void on_cache_access(int processor_id, int state_id);
 
-  void on_invalidate(int processor_id);
+  void on_invalidate(int processor_id, uint32_t address);
+
+  /**
+   * @brief Record the sharing pattern behind an invalidation/update of a line
+   * held by another cache
+   *
+   * @param line_address
+   * @param kind
+   */
+  void on_sharing(uint32_t line_address, SharingKind kind);
 
   void register_state_parser(std::function<std::string(int)> parser) {
     state_parser = parser;
   }
 
-  void on_write_back();
+  void on_write_back(uint32_t address);
+
+  void on_bus_traffic(int processor_id, uint32_t address, int num_words);
+
+  auto get_core_counters(int processor_id) const -> CoreCounters;
+
+  auto get_summary() const -> RunSummary;
 
-  void on_bus_traffic(int num_words);
+  void save(CheckpointWriter &writer) const;
+  void restore(CheckpointReader &reader);
 
   friend auto operator<<(std::ostream &os, const StatisticsAccumulator &p)
       -> std::ostream &;
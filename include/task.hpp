@@ -0,0 +1,169 @@
+#pragma once
+#include "trace.hpp"
+
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <optional>
+#include <utility>
+
+/**
+ * @brief Something a suspended task waits for. It is polled once per cycle
+ * from the cycle its source says it may fire on, and the task only resumes
+ * in the cycle it fires.
+ *
+ */
+class Event {
+public:
+  virtual auto poll(int32_t curr_cycle) -> bool = 0;
+
+protected:
+  ~Event() = default;
+};
+
+/**
+ * @brief A protocol action spanning several cycles, written as a coroutine
+ * that co_awaits the events it depends on and co_returns the resulting
+ * instruction, a null instruction once the access is done.
+ *
+ * The first run_once() runs the task up to its first co_await. After that,
+ * run_once() only resumes it in the cycle its event fires. Events are not
+ * pushed by their sources but polled by run_once(): a memory access tells
+ * when it completes, so its task is not polled before then, whereas the
+ * snoop responses are collected by broadcasting the request again every
+ * cycle, which is part of the protocol, so their event is polled each cycle.
+ *
+ */
+class Task {
+public:
+  struct promise_type {
+    std::optional<Instruction> result;
+    Event *event = nullptr;
+    // The event is not polled before this cycle
+    int32_t poll_cycle = 0;
+    int32_t curr_cycle = 0;
+
+    auto get_return_object() -> Task {
+      return Task{std::coroutine_handle<promise_type>::from_promise(*this)};
+    }
+    auto initial_suspend() noexcept -> std::suspend_always { return {}; }
+    auto final_suspend() noexcept -> std::suspend_always { return {}; }
+    void return_value(Instruction instr) { result = instr; }
+    void unhandled_exception() { std::terminate(); }
+
+    // Frames are recycled, see task.cpp
+    static auto operator new(size_t size) -> void *;
+    static void operator delete(void *frame, size_t size);
+  };
+
+  explicit Task(std::coroutine_handle<promise_type> handle)
+      : handle(handle) {}
+  Task(Task &&other) noexcept : handle(std::exchange(other.handle, {})) {}
+  Task(const Task &) = delete;
+  auto operator=(Task other) noexcept -> Task & {
+    std::swap(handle, other.handle);
+    return *this;
+  }
+  ~Task() {
+    if (handle) {
+      handle.destroy();
+    }
+  }
+
+  auto is_done() const -> bool { return handle.done(); }
+
+  /**
+   * @brief The co_returned instruction. Must only be called when is_done()
+   *
+   * @return Instruction
+   */
+  auto result() const -> Instruction { return handle.promise().result.value(); }
+
+  /**
+   * @brief Start the task, or poll the awaited event at `curr_cycle` if it
+   * may have fired and resume the task if it did. Returns whether the task is
+   * done
+   *
+   * @param curr_cycle
+   * @return bool
+   */
+  auto run_once(int32_t curr_cycle) -> bool {
+    auto &promise = handle.promise();
+    if (promise.event && (curr_cycle < promise.poll_cycle ||
+                          !promise.event->poll(curr_cycle))) {
+      return false;
+    }
+    promise.event = nullptr;
+    promise.curr_cycle = curr_cycle;
+    handle.resume();
+    return handle.done();
+  }
+
+  /**
+   * @brief Awaitable that suspends until `condition(curr_cycle)` holds. It is
+   * first tried in the cycle it is awaited, and evaluates to the cycle in
+   * which it held. Whenever it does not hold, `cycles_left()` is how many
+   * cycles it certainly will not hold for.
+   *
+   */
+  template <typename Condition, typename CyclesLeft>
+  class Until : public Event {
+  private:
+    Condition condition;
+    CyclesLeft cycles_left;
+    promise_type *promise = nullptr;
+
+  public:
+    Until(Condition condition, CyclesLeft cycles_left)
+        : condition(std::move(condition)), cycles_left(std::move(cycles_left)) {
+    }
+
+    auto poll(int32_t curr_cycle) -> bool override {
+      if (condition(curr_cycle)) {
+        return true;
+      }
+      promise->poll_cycle = curr_cycle + cycles_left();
+      return false;
+    }
+
+    auto await_ready() const noexcept -> bool { return false; }
+    auto await_suspend(std::coroutine_handle<promise_type> handle) -> bool {
+      promise = &handle.promise();
+      if (poll(promise->curr_cycle)) {
+        return false;
+      }
+      promise->event = this;
+      return true;
+    }
+    auto await_resume() const noexcept -> int32_t {
+      return promise->curr_cycle;
+    }
+  };
+
+private:
+  std::coroutine_handle<promise_type> handle;
+};
+
+/**
+ * @brief Wait until `condition(curr_cycle)` holds, checking it again only
+ * `cycles_left()` cycles after each time it does not
+ *
+ * @param condition
+ * @param cycles_left
+ */
+template <typename Condition, typename CyclesLeft>
+auto until(Condition condition, CyclesLeft cycles_left) {
+  return Task::Until<Condition, CyclesLeft>{std::move(condition),
+                                            std::move(cycles_left)};
+}
+
+/**
+ * @brief Wait until `condition(curr_cycle)` holds, e.g.
+ * `curr_cycle = co_await until([&](int32_t) { return is_ready(); });`
+ *
+ * @param condition
+ */
+template <typename Condition> auto until(Condition condition) {
+  return until(std::move(condition), [] { return 1; });
+}
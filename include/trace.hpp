@@ -2,6 +2,7 @@
 
 #include "cstdint"
 #include "filesystem"
+#include "fstream"
 #include "optional"
 #include "vector"
 
@@ -10,20 +11,154 @@ constexpr auto NUM_CORES = 4;
 enum InstructionType { READ = 0, WRITE = 1, OTHER = 2 };
 using Value = uint32_t;
 
+struct ParsedAddress {
+  uint32_t tag;
+  uint32_t set_index;
+  uint32_t offset;
+  uint32_t address;
+};
+
+/**
+ * @brief Number of offset and set index bits of a cache, which decide how
+ * its addresses are split
+ *
+ */
+struct AddressGeometry {
+  int num_offset_bits;
+  int num_set_index_bits;
+
+  friend auto operator==(const AddressGeometry &, const AddressGeometry &)
+      -> bool = default;
+};
+
+/**
+ * @brief Split an address into tag, set index and offset for the given
+ * geometry
+ *
+ * @param address
+ * @param num_offset_bits
+ * @param num_set_index_bits
+ * @return ParsedAddress
+ */
+inline auto parse_address(uint32_t address, int num_offset_bits,
+                          int num_set_index_bits) -> ParsedAddress {
+  auto offset = address & ((1 << num_offset_bits) - 1);
+  auto set_index =
+      (address >> num_offset_bits) & ((1 << num_set_index_bits) - 1);
+  auto tag = address >> (num_offset_bits + num_set_index_bits);
+  return ParsedAddress{tag, set_index, offset, address};
+}
+
 class Instruction {
 public:
   InstructionType label;
   std::optional<int> num_cycles;
   std::optional<int> address;
+  // Address split for the simulated geometry, if decoded ahead of time
+  std::optional<ParsedAddress> parsed_address;
   Instruction(InstructionType label, std::optional<int> num_cycles,
-              std::optional<int> address)
-      : label(label), num_cycles(num_cycles), address(address) {}
+              std::optional<int> address,
+              std::optional<ParsedAddress> parsed_address = std::nullopt)
+      : label(label), num_cycles(num_cycles), address(address),
+        parsed_address(parsed_address) {}
 };
 
 auto is_null_instr(const Instruction &instr) -> bool;
 
-auto parse_traces(std::string path_str)
-    -> std::array<std::vector<Instruction>, NUM_CORES>;
+// Binary traces start with this magic, followed by packed records
+static constexpr char BINARY_TRACE_MAGIC[8] = {'C', 'O', 'H', 'T',
+                                               'R', 'C', '0', '1'};
+struct BinaryTraceRecord {
+  uint32_t label;
+  uint32_t value; // Address, or number of cycles for OTHER
+};
+
+/**
+ * @brief Buffered writer of one core's trace, either as text or in the
+ * binary format. Both are accepted by read_trace.
+ *
+ */
+class TraceWriter {
+private:
+  std::ofstream file;
+  const bool is_binary;
+  std::vector<char> buffer;
+
+  void flush();
+
+public:
+  TraceWriter(const std::filesystem::path &path, bool is_binary);
+  ~TraceWriter();
+
+  void write(const Instruction &instr);
+};
+
+// Decoded traces start with a DecodedTraceHeader, followed by packed records
+static constexpr char DECODED_TRACE_MAGIC[8] = {'C', 'O', 'H', 'T',
+                                                'R', 'D', '0', '2'};
+struct DecodedTraceHeader {
+  char magic[sizeof(DECODED_TRACE_MAGIC)];
+  AddressGeometry geometry;
+  uint64_t num_records;
+  // Size and modification time of the trace it was decoded from
+  uint64_t source_size;
+  int64_t source_mtime;
+};
+struct DecodedTraceRecord {
+  uint32_t label;
+  uint32_t value; // Address, or number of cycles for OTHER
+  uint32_t tag;
+  uint32_t set_index;
+};
+
+/**
+ * @brief Split the address of every READ and WRITE for `geometry`, so that
+ * the simulation of that geometry does not have to
+ *
+ * @param instructions
+ * @param geometry
+ */
+void decode_trace(std::vector<Instruction> &instructions,
+                  const AddressGeometry &geometry);
+
+/**
+ * @brief Write a trace decoded from `source` by decode_trace(), to be read
+ * back by read_decoded_trace() instead of decoding it again. The file is
+ * written under a temporary name and renamed into place, so that it is never
+ * seen half written. Failing to write it is only a warning.
+ *
+ * @param path
+ * @param instructions
+ * @param geometry
+ * @param source
+ */
+void write_decoded_trace(const std::filesystem::path &path,
+                         const std::vector<Instruction> &instructions,
+                         const AddressGeometry &geometry,
+                         const std::filesystem::path &source);
+
+/**
+ * @brief Read a trace written by write_decoded_trace(). Returns nullopt if
+ * the file is not a complete decoded trace of `source` as it is now, or was
+ * decoded for another geometry
+ *
+ * @param path
+ * @param geometry
+ * @param source
+ * @return std::optional<std::vector<Instruction>>
+ */
+auto read_decoded_trace(const std::filesystem::path &path,
+                        const AddressGeometry &geometry,
+                        const std::filesystem::path &source)
+    -> std::optional<std::vector<Instruction>>;
+
+/**
+ * @brief Read a single core's trace file, in text or binary format
+ *
+ * @param path
+ * @return std::vector<Instruction>
+ */
+auto read_trace(const std::filesystem::path &path) -> std::vector<Instruction>;
 
 auto to_string(const InstructionType &instr_type) -> std::string;
 
@@ -0,0 +1,212 @@
+#pragma once
+
+#include "trace.hpp"
+#include "workload.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+/**
+ * @brief A core's instruction stream, fetched one instruction at a time
+ *
+ */
+class TraceSource {
+public:
+  virtual ~TraceSource() = default;
+
+  virtual auto is_empty() const -> bool = 0;
+
+  /**
+   * @brief Fetch the next instruction. Must not be called when is_empty()
+   *
+   * @return Instruction
+   */
+  virtual auto next() -> Instruction = 0;
+
+  /**
+   * @brief Discard the next `count` instructions, or as many as are left
+   *
+   * @param count
+   * @return uint64_t Number of instructions discarded
+   */
+  virtual auto skip(uint64_t count) -> uint64_t {
+    auto num_skipped = uint64_t{0};
+    for (; num_skipped < count && !is_empty(); num_skipped++) {
+      next();
+    }
+    return num_skipped;
+  }
+};
+
+using TraceSources = std::array<std::unique_ptr<TraceSource>, NUM_CORES>;
+
+// Traces loaded into memory once and read by several systems
+using SharedTraces =
+    std::array<std::shared_ptr<const std::vector<Instruction>>, NUM_CORES>;
+
+/**
+ * @brief Trace already held in memory, possibly shared with other sources
+ *
+ */
+class VectorTraceSource : public TraceSource {
+private:
+  std::shared_ptr<const std::vector<Instruction>> instructions;
+  size_t next_idx = 0;
+
+public:
+  explicit VectorTraceSource(std::vector<Instruction> instructions)
+      : instructions(std::make_shared<const std::vector<Instruction>>(
+            std::move(instructions))) {}
+  explicit VectorTraceSource(
+      std::shared_ptr<const std::vector<Instruction>> instructions)
+      : instructions(std::move(instructions)) {}
+
+  auto is_empty() const -> bool override {
+    return next_idx == instructions->size();
+  }
+  auto next() -> Instruction override { return instructions->at(next_idx++); }
+  auto skip(uint64_t count) -> uint64_t override {
+    const auto num_skipped =
+        std::min<uint64_t>(count, instructions->size() - next_idx);
+    next_idx += num_skipped;
+    return num_skipped;
+  }
+};
+
+/**
+ * @brief Trace file in text or binary format, streamed in fixed-size chunks
+ * so that memory use does not grow with the length of the trace
+ *
+ */
+class FileTraceSource : public TraceSource {
+private:
+  std::ifstream file;
+  bool is_binary = false;
+  std::vector<Instruction> buffer;
+  size_t next_idx = 0;
+
+  void refill();
+
+public:
+  explicit FileTraceSource(const std::filesystem::path &path);
+
+  auto is_empty() const -> bool override { return next_idx == buffer.size(); }
+  auto next() -> Instruction override;
+
+  auto has_binary_format() const -> bool { return is_binary; }
+};
+
+/**
+ * @brief Generates a fixed number of instructions of a workload pattern on
+ * the fly, in constant memory and without any I/O
+ *
+ */
+class SyntheticTraceSource : public TraceSource {
+private:
+  WorkloadGenerator generator;
+  uint64_t num_remaining;
+
+public:
+  SyntheticTraceSource(const WorkloadConfig &config, int core,
+                       uint64_t length)
+      : generator(config, core), num_remaining(length) {}
+
+  auto is_empty() const -> bool override { return num_remaining == 0; }
+  auto next() -> Instruction override {
+    num_remaining--;
+    return generator.next();
+  }
+};
+
+static const std::string SYNTHETIC_INPUT_PREFIX = "synthetic:";
+
+// Appended to a binary trace file's name for its decoded form
+static const std::string DECODED_TRACE_SUFFIX = ".decoded";
+
+/**
+ * @brief Parse an input of the form synthetic:<pattern>. Returns nullopt if
+ * the input is not synthetic; throws if the pattern is unknown.
+ *
+ * @param input
+ * @return std::optional<WorkloadPattern>
+ */
+auto parse_synthetic_input(const std::string &input)
+    -> std::optional<WorkloadPattern>;
+
+/**
+ * @brief The input a run's traces come from, so that a checkpoint is only
+ * restored onto the same traces: the size and modification time of each
+ * core's trace file, or the pattern, seed and length of a synthetic input
+ *
+ */
+struct TraceIdentity {
+  int64_t pattern = -1; // WorkloadPattern of a synthetic input, -1 for files
+  uint64_t seed = 0;
+  // Bytes of each core's trace file, or instructions per core
+  std::array<uint64_t, NUM_CORES> lengths = {};
+  std::array<int64_t, NUM_CORES> mtimes = {};
+};
+
+auto trace_file_identity(const std::string &path_str) -> TraceIdentity;
+auto synthetic_trace_identity(const WorkloadConfig &config, uint64_t length)
+    -> TraceIdentity;
+
+/**
+ * @brief Open the per-core trace files <name>_<core>.data of a benchmark
+ * directory. Cores without a file (other than core 0) stay idle.
+ *
+ * @param path_str
+ * @return TraceSources
+ */
+auto open_trace_files(const std::string &path_str) -> TraceSources;
+
+/**
+ * @brief Read the trace files of a benchmark directory into memory, decoded
+ * for `geometry`. A binary trace keeps its decoded form next to it, in
+ * <name>_<core>.data.decoded, which is read instead of the trace as long as
+ * it was decoded for the same geometry from the trace's current size and
+ * modification time.
+ *
+ * @param path_str
+ * @param geometry
+ * @return SharedTraces
+ */
+auto load_decoded_trace_files(const std::string &path_str,
+                              const AddressGeometry &geometry)
+    -> SharedTraces;
+
+auto make_synthetic_sources(const WorkloadConfig &config, uint64_t length)
+    -> TraceSources;
+
+auto make_vector_sources(
+    const std::array<std::vector<Instruction>, NUM_CORES> &traces)
+    -> TraceSources;
+
+/**
+ * @brief Read every source into memory, to be shared by several systems,
+ * and decode it for `geometry` if given
+ *
+ * @param sources
+ * @param geometry
+ * @return SharedTraces
+ */
+auto load_traces(TraceSources &sources,
+                 const std::optional<AddressGeometry> &geometry = std::nullopt)
+    -> SharedTraces;
+
+auto make_shared_sources(const SharedTraces &traces) -> TraceSources;
+
+/**
+ * @brief Read the rest of a source into memory
+ *
+ * @param source
+ * @return std::vector<Instruction>
+ */
+auto drain(TraceSource &source) -> std::vector<Instruction>;
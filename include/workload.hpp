@@ -0,0 +1,114 @@
+#pragma once
+
+#include "trace.hpp"
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+enum class WorkloadPattern {
+  ProducerConsumer = 0, // Core 0 writes a buffer that the others read
+  Migratory = 1,        // Read-modify-writes of shared objects
+  ReadMostly = 2,       // Random reads of a shared table, rare writes
+  FalseSharing = 3,     // Each core owns one word of every shared line
+  Zipf = 4,             // Random accesses with a Zipf-distributed hot set
+  LockPingPong = 5,     // Spin on a lock, update a counter, release
+  Streaming = 6,        // Sequential private copy, no reuse
+};
+static const std::vector<std::string> WORKLOAD_PATTERNS = {
+    "producer-consumer", "migratory", "read-mostly", "false-sharing",
+    "zipf",              "lock",      "streaming"};
+
+auto to_string(const WorkloadPattern &pattern) -> std::string;
+auto parse_workload_pattern(const std::string &name)
+    -> std::optional<WorkloadPattern>;
+
+// Cores whose private regions fit in the 32-bit address space
+static constexpr auto MAX_WORKLOAD_CORES = 768;
+
+struct WorkloadConfig {
+  WorkloadPattern pattern = WorkloadPattern::Zipf;
+  int num_cores = NUM_CORES;
+  uint64_t seed = 1;
+  int block_size = 32;      // bytes
+  int footprint = 1024;     // lines of shared (or per-core streaming) data
+  int write_percent = 5;    // read-mostly, zipf
+  int compute_percent = 10; // chance of a compute burst before an operation
+  int max_compute_cycles = 10;
+  double zipf_skew = 0.99;
+};
+
+/**
+ * @brief xoshiro256** generator, seeded through splitmix64. Plain data, so a
+ * generator's position can be copied or saved.
+ *
+ */
+struct Xoshiro256 {
+  uint64_t s[4];
+
+  explicit Xoshiro256(uint64_t seed);
+
+  auto next() -> uint64_t;
+  auto below(uint32_t bound) -> uint32_t;
+  auto uniform() -> double; // In [0, 1)
+};
+
+/**
+ * @brief Zipf sampler over ranks 1..n by rejection-inversion (Hormann and
+ * Derflinger), which needs O(1) time and memory per sample.
+ *
+ */
+class ZipfSampler {
+private:
+  int n;
+  double exponent;
+  double h_integral_x1;
+  double h_integral_n;
+  double s;
+
+  auto h(double x) const -> double;
+  auto h_integral(double x) const -> double;
+  auto h_integral_inverse(double x) const -> double;
+
+public:
+  ZipfSampler(int n, double exponent);
+
+  auto sample(Xoshiro256 &rng) const -> int;
+};
+
+/**
+ * @brief Lazily generates the (unbounded) instruction stream of one core of
+ * a workload. Each core's stream depends only on the config, the seed and
+ * the core id.
+ *
+ */
+class WorkloadGenerator {
+private:
+  WorkloadConfig config;
+  int core;
+  Xoshiro256 rng;
+  ZipfSampler zipf;
+
+  uint64_t step = 0; // Number of operations generated so far
+
+  // Accesses of the current operation (e.g. a read-modify-write)
+  struct Access {
+    InstructionType label;
+    uint32_t address;
+  };
+  static constexpr auto MAX_ACCESSES_PER_OPERATION = 8;
+  Access pending[MAX_ACCESSES_PER_OPERATION] = {};
+  int num_pending = 0;
+  int next_pending = 0;
+
+  auto shared_address(uint32_t line, uint32_t word = 0) const -> uint32_t;
+  auto private_address(uint32_t line, uint32_t word = 0) const -> uint32_t;
+  void push(InstructionType label, uint32_t address);
+  void generate_operation();
+
+public:
+  WorkloadGenerator(const WorkloadConfig &config, int core);
+
+  auto next() -> Instruction;
+};
@@ -1,7 +1,9 @@
 #pragma once
 
 #include "cache.hpp"
+#include "checkpoint.hpp"
 #include "trace.hpp"
+#include <optional>
 #include <tuple>
 #include <vector>
 
@@ -19,9 +21,18 @@ public:
 
   auto add_to_queue(uint32_t address) -> bool;
 
-  auto run_once() -> bool;
+  /**
+   * @brief Advance the front write by one cycle. Returns its address once it
+   * has reached memory
+   *
+   * @return std::optional<uint32_t>
+   */
+  auto run_once() -> std::optional<uint32_t>;
 
   auto is_empty() -> bool;
 
   auto remove_if_present(uint32_t uint32_t) -> bool;
+
+  void save(CheckpointWriter &writer) const;
+  void restore(CheckpointReader &reader);
 };
\ No newline at end of file
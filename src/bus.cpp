@@ -1,24 +1,80 @@
 #include "bus.hpp"
 #include <iostream>
 
-Bus::Bus(int num_processors)
-    : response_completed_bits(num_processors, false),
-      response_is_present_bits(num_processors, false),
-      response_wait_bits(num_processors, false){};
+void ResponseBits::save(CheckpointWriter &writer) const {
+  auto bits = std::vector<bool>(num_bits);
+  for (auto id = 0; id < num_bits; id++) {
+    bits[id] = test(id);
+  }
+  writer.write(bits);
+}
+
+void ResponseBits::restore(CheckpointReader &reader) {
+  auto bits = std::vector<bool>{};
+  reader.read(bits);
+  if (static_cast<int>(bits.size()) != num_bits) {
+    std::cerr << "Checkpoint has " << bits.size() << " bus responses but the "
+              << "bus has " << num_bits << "!" << std::endl;
+    std::exit(1);
+  }
+  for (auto id = 0; id < num_bits; id++) {
+    set(id, bits[id]);
+  }
+}
+
+void SnoopTransaction::save(CheckpointWriter &writer) const {
+  writer.write(request);
+  polled.save(writer);
+  scheduled.save(writer);
+  writer.write(completion_cycles);
+  writer.write(next_completion_cycle);
+}
+
+void SnoopTransaction::restore(CheckpointReader &reader) {
+  reader.read(request);
+  polled.restore(reader);
+  scheduled.restore(reader);
+  reader.read(completion_cycles);
+  reader.read(next_completion_cycle);
+}
+
+Bus::Bus(int num_processors,
+         std::shared_ptr<StatisticsAccumulator> stats_accum)
+    : wait_cycles(num_processors, 0), stats_accum(stats_accum),
+      response_completed_bits(num_processors),
+      response_is_present_bits(num_processors),
+      response_wait_bits(num_processors), transaction(num_processors) {
+  registration_queue.reserve(num_processors);
+}
+
+void Bus::on_acquired(int controller_id) {
+  if (stats_accum) {
+    stats_accum->on_bus_wait(controller_id, wait_cycles.at(controller_id));
+  }
+  wait_cycles.at(controller_id) = 0;
+}
 
 auto Bus::acquire(int controller_id) -> int {
   if (just_released) {
+    wait_cycles.at(controller_id) += 1;
     return false;
   }
 
   if (!owner_id) {
     // Not owner -> make yourself owner
     owner_id = controller_id;
+    on_acquired(controller_id);
     return true;
   } else if (owner_id && owner_id.value() == controller_id) {
     // Got owner and I'm owner
+    if (wait_cycles.at(controller_id) > 0) {
+      // Ownership was handed over by release() while queueing
+      on_acquired(controller_id);
+    }
     return true;
   } else {
+    wait_cycles.at(controller_id) += 1;
+
     // Put yourself in queue, if you're not already in the queue
     auto is_in_queue{false};
     for (const auto x : registration_queue) {
@@ -44,7 +100,7 @@ void Bus::release(int controller_id) {
     // Get next owner if any
     if (!registration_queue.empty()) {
       owner_id = registration_queue.front();
-      registration_queue.pop_front();
+      registration_queue.erase(registration_queue.begin());
     }
   } else if (!owner_id) {
     std::cout << "Error: Bus is not owned by anyone but Core " << controller_id
@@ -57,11 +113,34 @@ void Bus::release(int controller_id) {
   }
 
   // std::cout << "Bus released by " << controller_id << std::endl;
-  already_flush = false;
-  already_busrd = false;
   just_released = true;
+  transaction.close();
 }
 
 auto Bus::get_owner_id() -> std::optional<int> { return owner_id; }
 
-auto Bus::reset() -> void { just_released = false; }
\ No newline at end of file
+auto Bus::reset() -> void { just_released = false; }
+
+void Bus::save(CheckpointWriter &writer) const {
+  writer.write(just_released);
+  writer.write(owner_id);
+  writer.write(registration_queue);
+  writer.write(wait_cycles);
+  writer.write(request_queue);
+  response_completed_bits.save(writer);
+  response_is_present_bits.save(writer);
+  response_wait_bits.save(writer);
+  transaction.save(writer);
+}
+
+void Bus::restore(CheckpointReader &reader) {
+  reader.read(just_released);
+  reader.read(owner_id);
+  reader.read(registration_queue);
+  reader.read(wait_cycles);
+  reader.read(request_queue);
+  response_completed_bits.restore(reader);
+  response_is_present_bits.restore(reader);
+  response_wait_bits.restore(reader);
+  transaction.restore(reader);
+}
@@ -0,0 +1,173 @@
+#include "checkpoint.hpp"
+
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+void CheckpointWriter::write(const std::vector<bool> &values) {
+  write(static_cast<uint64_t>(values.size()));
+  for (const auto value : values) {
+    write(static_cast<uint8_t>(value));
+  }
+}
+
+void CheckpointWriter::save(const std::filesystem::path &path) const {
+  auto file = std::ofstream{path, std::ios::binary | std::ios::trunc};
+  file.write(buffer.data(), buffer.size());
+  if (!file) {
+    std::cerr << "Unable to write checkpoint: " << path << std::endl;
+    std::exit(1);
+  }
+}
+
+CheckpointReader::CheckpointReader(const std::filesystem::path &path) {
+  const auto fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    std::cerr << "Unable to open checkpoint: " << path << std::endl;
+    std::exit(1);
+  }
+
+  struct stat st {};
+  if (::fstat(fd, &st) != 0) {
+    std::cerr << "Unable to stat checkpoint: " << path << std::endl;
+    std::exit(1);
+  }
+  size = static_cast<size_t>(st.st_size);
+
+  if (size > 0) {
+    auto mapped = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapped == MAP_FAILED) {
+      std::cerr << "Unable to map checkpoint: " << path << std::endl;
+      std::exit(1);
+    }
+    data = static_cast<const char *>(mapped);
+  }
+  // The mapping stays valid after the descriptor is closed
+  ::close(fd);
+}
+
+CheckpointReader::~CheckpointReader() {
+  if (data) {
+    ::munmap(const_cast<char *>(data), size);
+  }
+}
+
+void CheckpointReader::consume(void *out, size_t num_bytes) {
+  if (num_bytes > size - pos) {
+    std::cerr << "Checkpoint is truncated or corrupt (read of " << num_bytes
+              << " bytes at offset " << pos << " of " << size << ")"
+              << std::endl;
+    std::exit(1);
+  }
+  std::memcpy(out, data + pos, num_bytes);
+  pos += num_bytes;
+}
+
+void CheckpointReader::read(std::vector<bool> &values) {
+  auto num_values = uint64_t{0};
+  read(num_values);
+  values.resize(num_values);
+  for (auto i = uint64_t{0}; i < num_values; i++) {
+    auto value = uint8_t{0};
+    read(value);
+    values[i] = value != 0;
+  }
+}
+
+#ifdef USE_WRITE_BUFFER
+static constexpr auto HAS_WRITE_BUFFER = int32_t{1};
+#else
+static constexpr auto HAS_WRITE_BUFFER = int32_t{0};
+#endif
+
+auto make_checkpoint_header(const std::string &protocol, int num_cores,
+                            int cache_size, int associativity,
+                            int block_size, int cycle,
+                            const TraceIdentity &trace) -> CheckpointHeader {
+  auto header = CheckpointHeader{};
+  std::memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC));
+  protocol.copy(header.protocol, sizeof(header.protocol) - 1);
+  header.num_cores = num_cores;
+  header.cache_size = cache_size;
+  header.associativity = associativity;
+  header.block_size = block_size;
+  header.cycle = cycle;
+  header.write_buffer = HAS_WRITE_BUFFER;
+  header.trace = trace;
+  return header;
+}
+
+/**
+ * @brief Name of the input a trace identity describes
+ *
+ */
+static auto input_name(const TraceIdentity &trace) -> std::string {
+  if (trace.pattern < 0) {
+    return "trace files";
+  }
+  return SYNTHETIC_INPUT_PREFIX +
+         to_string(static_cast<WorkloadPattern>(trace.pattern));
+}
+
+void check_checkpoint_header(const CheckpointHeader &header,
+                             const std::string &protocol, int num_cores,
+                             int cache_size, int associativity,
+                             int block_size, const TraceIdentity &trace) {
+  const auto fail = [](const std::string &what, const auto &expected,
+                       const auto &actual) {
+    std::cerr << "Checkpoint " << what << " is " << actual << " but the run "
+              << "uses " << expected << "!" << std::endl;
+    std::exit(1);
+  };
+
+  if (std::memcmp(header.magic, CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC)) !=
+      0) {
+    std::cerr << "Not a checkpoint file!" << std::endl;
+    std::exit(1);
+  }
+  const auto header_protocol = std::string{
+      header.protocol, strnlen(header.protocol, sizeof(header.protocol))};
+  if (header_protocol != protocol) {
+    fail("protocol", protocol, header_protocol);
+  }
+  if (header.num_cores != num_cores) {
+    fail("number of cores", num_cores, header.num_cores);
+  }
+  if (header.cache_size != cache_size) {
+    fail("cache size", cache_size, header.cache_size);
+  }
+  if (header.associativity != associativity) {
+    fail("associativity", associativity, header.associativity);
+  }
+  if (header.block_size != block_size) {
+    fail("block size", block_size, header.block_size);
+  }
+  if (header.write_buffer != HAS_WRITE_BUFFER) {
+    const auto memory_model = [](int32_t write_buffer) {
+      return write_buffer ? "a write buffer" : "no write buffer";
+    };
+    fail("memory model", memory_model(HAS_WRITE_BUFFER),
+         memory_model(header.write_buffer));
+  }
+
+  if (header.trace.pattern != trace.pattern) {
+    fail("input", input_name(trace), input_name(header.trace));
+  }
+  if (header.trace.seed != trace.seed) {
+    fail("synthetic seed", trace.seed, header.trace.seed);
+  }
+  for (int i = 0; i < num_cores; i++) {
+    const auto core = " of core " + std::to_string(i) + "'s trace";
+    if (header.trace.lengths.at(i) != trace.lengths.at(i)) {
+      fail("length" + core, trace.lengths.at(i), header.trace.lengths.at(i));
+    }
+    if (header.trace.mtimes.at(i) != trace.mtimes.at(i)) {
+      std::cerr << "Core " << i << "'s trace was modified after the "
+                << "checkpoint was taken!" << std::endl;
+      std::exit(1);
+    }
+  }
+}
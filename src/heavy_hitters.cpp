@@ -0,0 +1,106 @@
+#include "heavy_hitters.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace {
+// Odd multipliers for multiply-shift hashing, one per sketch row
+constexpr std::array<uint64_t, SKETCH_DEPTH> HASH_SEEDS = {
+    0x9e3779b97f4a7c15, 0xbf58476d1ce4e5b9, 0x94d049bb133111eb,
+    0xd6e8feb86659fd93};
+constexpr auto SKETCH_WIDTH_BITS = 11;
+static_assert(1 << SKETCH_WIDTH_BITS == SKETCH_WIDTH);
+} // namespace
+
+CountMinSketch::CountMinSketch() : counters(SKETCH_DEPTH * SKETCH_WIDTH, 0) {}
+
+auto CountMinSketch::bucket(int row, uint32_t key) -> int {
+  return static_cast<int>((HASH_SEEDS[row] * (key + 1)) >>
+                          (64 - SKETCH_WIDTH_BITS));
+}
+
+void CountMinSketch::add(uint32_t key, uint64_t weight) {
+  for (auto row = 0; row < SKETCH_DEPTH; row++) {
+    counters[row * SKETCH_WIDTH + bucket(row, key)] += weight;
+  }
+  total += weight;
+}
+
+auto CountMinSketch::estimate(uint32_t key) const -> uint64_t {
+  auto min = std::numeric_limits<uint64_t>::max();
+  for (auto row = 0; row < SKETCH_DEPTH; row++) {
+    min = std::min(min, counters[row * SKETCH_WIDTH + bucket(row, key)]);
+  }
+  return min;
+}
+
+auto CountMinSketch::error_bound() const -> uint64_t {
+  return static_cast<uint64_t>(std::ceil(std::exp(1.0) * total / SKETCH_WIDTH));
+}
+
+void CountMinSketch::save(CheckpointWriter &writer) const {
+  writer.write(counters);
+  writer.write(total);
+}
+
+void CountMinSketch::restore(CheckpointReader &reader) {
+  reader.read(counters);
+  reader.read(total);
+}
+
+auto SpaceSaving::add(uint32_t key, uint64_t weight) -> std::pair<int, bool> {
+  auto min_idx = 0;
+  for (auto i = 0; i < size; i++) {
+    if (entries[i].key == key) {
+      entries[i].count += weight;
+      return {i, false};
+    }
+    if (entries[i].count < entries[min_idx].count) {
+      min_idx = i;
+    }
+  }
+
+  if (size < NUM_HEAVY_HITTERS) {
+    entries[size] = Entry{key, weight, 0};
+    size += 1;
+    return {size - 1, true};
+  }
+  // Evict the lightest key; the newcomer inherits its count as error
+  const auto min_count = entries[min_idx].count;
+  entries[min_idx] = Entry{key, min_count + weight, min_count};
+  return {min_idx, true};
+}
+
+auto SpaceSaving::top() const -> std::vector<Entry> {
+  auto sorted = std::vector<Entry>(entries.begin(), entries.begin() + size);
+  std::sort(sorted.begin(), sorted.end(), [](const auto &a, const auto &b) {
+    return a.count != b.count ? a.count > b.count : a.key < b.key;
+  });
+  return sorted;
+}
+
+void SpaceSaving::save(CheckpointWriter &writer) const {
+  writer.write(entries);
+  writer.write(size);
+}
+
+void SpaceSaving::restore(CheckpointReader &reader) {
+  reader.read(entries);
+  reader.read(size);
+}
+
+void HeavyHitterTracker::print(std::ostream &os,
+                               const std::string &label) const {
+  const auto entries = top_k.top();
+  const auto num_printed =
+      std::min<int>(NUM_HOT_LINES_REPORTED, entries.size());
+  os << "\t " << label << " (total: " << sketch.total_weight()
+     << ", sketch error: <= " << sketch.error_bound() << "):\n";
+  for (auto i = 0; i < num_printed; i++) {
+    const auto &entry = entries.at(i);
+    const auto upper = std::min(entry.count, sketch.estimate(entry.key));
+    os << "\t\t 0x" << std::hex << entry.key << std::dec << ": ["
+       << entry.count - entry.error << ", " << upper << "]\n";
+  }
+}
@@ -0,0 +1,114 @@
+#include "interval_recorder.hpp"
+#include "cache.hpp"
+
+#include <iostream>
+
+IntervalRecorder::IntervalRecorder(int num_cores, int interval,
+                                   const std::string &path, int capacity)
+    : num_cores(num_cores), interval(interval), ring(capacity),
+      previous(num_cores), output(path) {
+  if (!output) {
+    std::cerr << "Unable to open interval statistics file: " << path
+              << std::endl;
+    std::exit(1);
+  }
+
+  for (auto &snapshot : ring) {
+    snapshot.cores.resize(num_cores);
+  }
+
+  output << "end_cycle,core,read_hits,write_hits,misses,idle_cycles,"
+            "bus_traffic_bytes,invalidates\n";
+  writer = std::thread{&IntervalRecorder::write_loop, this};
+}
+
+IntervalRecorder::~IntervalRecorder() {
+  {
+    std::lock_guard<std::mutex> lock{mutex};
+    stopped = true;
+  }
+  not_empty.notify_one();
+  if (writer.joinable()) {
+    writer.join();
+  }
+}
+
+void IntervalRecorder::record(int cycle,
+                              const StatisticsAccumulator &stats_accum) {
+  std::unique_lock<std::mutex> lock{mutex};
+  not_full.wait(lock, [this] { return head - tail < ring.size(); });
+  auto &snapshot = ring.at(head % ring.size());
+  lock.unlock();
+
+  // The slot is owned by the simulation until head is advanced
+  snapshot.end_cycle = cycle + 1;
+  for (auto i = 0; i < num_cores; i++) {
+    const auto curr = stats_accum.get_core_counters(i);
+    const auto &prev = previous.at(i);
+    snapshot.cores.at(i) = CoreCounters{
+        curr.read_hits - prev.read_hits,   curr.write_hits - prev.write_hits,
+        curr.misses - prev.misses,         curr.idles - prev.idles,
+        curr.bus_traffic - prev.bus_traffic,
+        curr.invalidates - prev.invalidates};
+    previous.at(i) = curr;
+  }
+  last_end_cycle = snapshot.end_cycle;
+
+  lock.lock();
+  head += 1;
+  lock.unlock();
+  not_empty.notify_one();
+}
+
+void IntervalRecorder::resume(int cycle,
+                              const StatisticsAccumulator &stats_accum) {
+  for (auto i = 0; i < num_cores; i++) {
+    previous.at(i) = stats_accum.get_core_counters(i);
+  }
+  last_end_cycle = cycle + 1;
+}
+
+void IntervalRecorder::close(int cycle,
+                             const StatisticsAccumulator &stats_accum) {
+  if (cycle + 1 > last_end_cycle) {
+    record(cycle, stats_accum);
+  }
+
+  {
+    std::lock_guard<std::mutex> lock{mutex};
+    stopped = true;
+  }
+  not_empty.notify_one();
+  if (writer.joinable()) {
+    writer.join();
+  }
+  output.flush();
+}
+
+void IntervalRecorder::write_loop() {
+  std::unique_lock<std::mutex> lock{mutex};
+  while (true) {
+    not_empty.wait(lock, [this] { return stopped || tail < head; });
+    if (tail == head && stopped) {
+      return;
+    }
+
+    // Slots in [tail, head) are owned by the writer
+    const auto end = head;
+    lock.unlock();
+    for (auto slot = tail; slot < end; slot++) {
+      const auto &snapshot = ring.at(slot % ring.size());
+      for (auto i = 0; i < num_cores; i++) {
+        const auto &counters = snapshot.cores.at(i);
+        output << snapshot.end_cycle << "," << i << "," << counters.read_hits
+               << "," << counters.write_hits << "," << counters.misses << ","
+               << counters.idles << ","
+               << counters.bus_traffic * (WORD_SIZE >> 3) << ","
+               << counters.invalidates << "\n";
+      }
+    }
+    lock.lock();
+    tail = end;
+    not_full.notify_one();
+  }
+}
@@ -0,0 +1,79 @@
+#include "latency_histogram.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <sstream>
+
+auto LatencyHistogram::bucket_index(int value) -> int {
+  const auto v = static_cast<uint32_t>(std::max(value, 0));
+  if (v < SUB_BUCKET_COUNT) {
+    return static_cast<int>(v);
+  }
+  // Keep the SUB_BUCKET_BITS most significant bits of the value
+  const auto shift = std::bit_width(v) - SUB_BUCKET_BITS;
+  const auto mantissa = v >> shift; // In [HALF_SUB_BUCKET_COUNT, SUB_BUCKET_COUNT)
+  return static_cast<int>(shift * HALF_SUB_BUCKET_COUNT + mantissa);
+}
+
+auto LatencyHistogram::bucket_upper_bound(int index) -> int {
+  if (index < SUB_BUCKET_COUNT) {
+    return index;
+  }
+  const auto shift = (index - HALF_SUB_BUCKET_COUNT) / HALF_SUB_BUCKET_COUNT;
+  const auto mantissa = index - shift * HALF_SUB_BUCKET_COUNT;
+  const auto upper = ((static_cast<int64_t>(mantissa) + 1) << shift) - 1;
+  return static_cast<int>(std::min<int64_t>(upper, INT32_MAX));
+}
+
+void LatencyHistogram::record(int value) {
+  counts[bucket_index(value)] += 1;
+  total += 1;
+  sum += value;
+  max_value = std::max(max_value, value);
+}
+
+auto LatencyHistogram::mean() const -> double {
+  return total == 0 ? 0.0 : sum / static_cast<double>(total);
+}
+
+auto LatencyHistogram::value_at_percentile(double percentile) const -> int {
+  if (total == 0) {
+    return 0;
+  }
+  const auto target = std::max<uint64_t>(
+      1, static_cast<uint64_t>(std::ceil(percentile / 100.0 * total)));
+  auto seen = uint64_t{0};
+  for (auto i = 0; i < NUM_BUCKETS; i++) {
+    seen += counts[i];
+    if (seen >= target) {
+      return std::min(bucket_upper_bound(i), max_value);
+    }
+  }
+  return max_value;
+}
+
+auto LatencyHistogram::summary() const -> std::string {
+  std::stringstream ss;
+  ss << "n=" << total;
+  if (total > 0) {
+    ss << " mean=" << mean() << " p50=" << value_at_percentile(50)
+       << " p90=" << value_at_percentile(90)
+       << " p99=" << value_at_percentile(99) << " max=" << max_value;
+  }
+  return ss.str();
+}
+
+void LatencyHistogram::save(CheckpointWriter &writer) const {
+  writer.write(counts);
+  writer.write(total);
+  writer.write(sum);
+  writer.write(max_value);
+}
+
+void LatencyHistogram::restore(CheckpointReader &reader) {
+  reader.read(counts);
+  reader.read(total);
+  reader.read(sum);
+  reader.read(max_value);
+}
@@ -1,102 +1,174 @@
-#include "bus.hpp"
-#include "cache.hpp"
-#include "cache_controller.hpp"
-#include "memory_controller.hpp"
+#include "interval_recorder.hpp"
 #include "parser.hpp"
-#include "processor.hpp"
+#include "sampling.hpp"
+#include "simulation.hpp"
+#include "stack_distance.hpp"
 #include "statistics.hpp"
 #include "trace.hpp"
+#include "trace_source.hpp"
+#include "workload.hpp"
 
-#include "protocols/dragon.hpp"
-#include "protocols/mesi.hpp"
-#include "protocols/mesif.hpp"
-#include "protocols/moesi.hpp"
-
-#include <algorithm>
 #include <array>
-#include <cstring>
+#include <chrono>
+#include <iomanip>
 #include <iostream>
 #include <memory>
-#include <random>
+#include <optional>
 #include <sstream>
 #include <stdexcept>
 #include <string>
-#include <tuple>
-#include <variant>
+#include <thread>
 #include <vector>
 
-static constexpr int PRINT_INTERVAL = 1000000;
-static constexpr char UNIT = 'M';
+struct RunOptions {
+  std::string protocol;
+  int stats_interval;
+  std::string stats_output;
+  std::optional<int> checkpoint_at;
+  std::string checkpoint_output;
+  std::optional<std::string> restore_from;
+  TraceIdentity trace_identity;
+  int num_threads;
+  bool oversubscribe;
+  int64_t warmup;
+  std::optional<SamplingConfig> sampling;
+};
+
+/**
+ * @brief Simulate one protocol and write its report to `out`
+ *
+ */
+template <typename Protocol, typename Geometry>
+auto simulate(const SystemConfig &config, TraceSources trace_sources,
+              const RunOptions &options, std::ostream &out) -> RunSummary {
+  auto stats_accum = make_statistics_accumulator<Protocol>(config.block_size);
+
+  // Create Bus, Memory Controller, Cache Controllers and Processors
+  auto system = System<Protocol, Geometry>{config, std::move(trace_sources),
+                                           stats_accum};
+  const auto num_threads =
+      system.set_num_threads(options.num_threads, options.oversubscribe);
+  if (num_threads > 1) {
+    out << "Threads: " << num_threads << std::endl;
+  }
 
-// Get Cache Protocol
-using MESIProcessor = Processor<MESIProtocol>;
-using MESICacheController = CacheController<MESIProtocol>;
+  if (options.restore_from) {
+    restore_checkpoint(options.restore_from.value(), options.protocol, config,
+                       options.trace_identity, system);
+    out << "Restored checkpoint " << options.restore_from.value()
+        << " at cycle " << system.cycle << std::endl;
+  } else if (options.warmup > 0) {
+    const auto start = std::chrono::steady_clock::now();
+    const auto num_accesses = system.warm_up(options.warmup);
+    const auto seconds = std::chrono::duration<double>(
+                             std::chrono::steady_clock::now() - start)
+                             .count();
+    out << "Warmed up with " << num_accesses << " accesses in " << seconds
+        << "s" << std::endl;
+  }
 
-using DragonProcessor = Processor<DragonProtocol>;
-using DragonCacheController = CacheController<DragonProtocol>;
+  // Run simulation
+  out << std::endl;
+  out << "-------------------------SIMULATION BEGIN-------------------------"
+      << std::endl;
+
+  auto interval_recorder =
+      options.stats_interval > 0
+          ? std::make_unique<IntervalRecorder>(
+                NUM_CORES, options.stats_interval, options.stats_output)
+          : nullptr;
+  if (interval_recorder && options.restore_from) {
+    interval_recorder->resume(system.cycle, *stats_accum);
+  }
 
-using MOESIProcessor = Processor<MOESIProtocol>;
-using MOESICacheController = CacheController<MOESIProtocol>;
+  if (options.checkpoint_at) {
+    const auto checkpoint_at = options.checkpoint_at.value();
+    if (system.cycle >= checkpoint_at) {
+      out << "Skipping checkpoint: cycle " << checkpoint_at
+          << " was already simulated" << std::endl;
+    } else if (system.run_until_checkpoint(checkpoint_at,
+                                           interval_recorder.get())) {
+      out << "Skipping checkpoint: simulation ended at cycle " << system.cycle
+          << std::endl;
+    } else {
+      save_checkpoint(options.checkpoint_output, options.protocol, config,
+                      options.trace_identity, system);
+      out << "Checkpoint written to " << options.checkpoint_output
+          << " at cycle " << system.cycle << " (requested " << checkpoint_at
+          << ")" << std::endl;
+    }
+  }
+  auto estimator = std::unique_ptr<SamplingEstimator>{};
+  if (options.sampling) {
+    estimator = std::make_unique<SamplingEstimator>(NUM_CORES,
+                                                    options.sampling.value());
+    system.run_sampled(options.sampling.value(), *estimator);
+  } else {
+    system.run(interval_recorder.get());
+  }
 
-using MESIFProcessor = Processor<MESIFProtocol>;
-using MESIFCacheController = CacheController<MESIFProtocol>;
+  out << std::endl;
+  out << "-------------------------SIMULATION END-------------------------"
+      << std::endl;
 
-// Processor
-using var_t =
-    std::variant<std::tuple<std::vector<std::shared_ptr<MESICacheController>>,
-                            std::vector<std::shared_ptr<MESIProcessor>>>,
-                 std::tuple<std::vector<std::shared_ptr<DragonCacheController>>,
-                            std::vector<std::shared_ptr<DragonProcessor>>>,
-                 std::tuple<std::vector<std::shared_ptr<MOESICacheController>>,
-                            std::vector<std::shared_ptr<MOESIProcessor>>>,
-                 std::tuple<std::vector<std::shared_ptr<MESIFCacheController>>,
-                            std::vector<std::shared_ptr<MESIFProcessor>>>>;
+  out << std::endl;
+  out << "-------------------------CACHE CONTENT-------------------------"
+      << std::endl;
+  system.print_cache_content(out);
+  out << "-------------------------CACHE END-------------------------"
+      << std::endl;
 
-template <typename Protocol>
-auto build_cache_controllers(
-    int cache_size, int associativity, int block_size, std::shared_ptr<Bus> bus,
-    std::shared_ptr<MemoryController> memory_controller,
-    std::shared_ptr<StatisticsAccumulator> stats_accum) {
-  auto cache_controllers =
-      std::vector<std::shared_ptr<CacheController<Protocol>>>{};
-  cache_controllers.reserve(NUM_CORES);
-  for (int i = 0; i < NUM_CORES; i++) {
-    cache_controllers.emplace_back(std::make_shared<CacheController<Protocol>>(
-        i, cache_size, associativity, block_size, bus, memory_controller,
-        stats_accum));
+  out << *stats_accum << std::endl;
+  if (estimator) {
+    out << *estimator << std::endl;
   }
-  std::for_each(cache_controllers.begin(), cache_controllers.end(),
-                [&cache_controllers](auto &&cc) {
-                  cc->register_cache_controllers(cache_controllers);
-                });
-  return cache_controllers;
+  return stats_accum->get_summary();
 }
 
-template <typename Protocol>
-auto build_cores(
-    std::array<std::vector<Instruction>, NUM_CORES> traces,
-    std::vector<std::shared_ptr<CacheController<Protocol>>> cache_controllers,
-    std::shared_ptr<StatisticsAccumulator> stats_accum) {
-  auto ready_cores = std::vector<std::shared_ptr<Processor<Protocol>>>{};
-  for (int i = 0; i < NUM_CORES; i++) {
-    ready_cores.emplace_back(std::make_shared<Processor<Protocol>>(
-        i, traces.at(i), cache_controllers.at(i), stats_accum));
-  }
-  return ready_cores;
+/**
+ * @brief Simulate the protocol named `protocol`
+ *
+ */
+auto simulate(const std::string &protocol, const SystemConfig &config,
+              TraceSources trace_sources, RunOptions options,
+              std::ostream &out) -> RunSummary {
+  options.protocol = protocol;
+  return with_geometry(config, [&]<typename Geometry>() {
+    if (protocol == SUPPORTED_PROTOCOLS.at(0)) {
+      return simulate<MESIProtocol, Geometry>(config, std::move(trace_sources),
+                                              options, out);
+    } else if (protocol == SUPPORTED_PROTOCOLS.at(1)) {
+      return simulate<DragonProtocol, Geometry>(
+          config, std::move(trace_sources), options, out);
+    } else if (protocol == SUPPORTED_PROTOCOLS.at(2)) {
+      return simulate<MOESIProtocol, Geometry>(
+          config, std::move(trace_sources), options, out);
+    } else {
+      return simulate<MESIFProtocol, Geometry>(
+          config, std::move(trace_sources), options, out);
+    }
+  });
 }
 
-template <typename Protocol>
-auto build_caches_and_cores(
-    int cache_size, int associativity, int block_size, std::shared_ptr<Bus> bus,
-    std::array<std::vector<Instruction>, NUM_CORES> traces,
-    std::shared_ptr<MemoryController> memory_controller,
-    std::shared_ptr<StatisticsAccumulator> stats_accum) {
-  auto cache_controllers =
-      build_cache_controllers<Protocol>(cache_size, associativity, block_size,
-                                        bus, memory_controller, stats_accum);
-  return std::make_tuple(
-      cache_controllers,
-      build_cores<Protocol>(traces, cache_controllers, stats_accum));
+/**
+ * @brief Print the headline results of each protocol side by side
+ *
+ */
+void print_comparison(const std::vector<std::string> &protocols,
+                      const std::vector<RunSummary> &summaries) {
+  std::cout << "-------------PROTOCOL COMPARISON-------------\n";
+  std::cout << std::left << std::setw(10) << "Protocol" << std::right
+            << std::setw(18) << "Execution Cycles" << std::setw(22)
+            << "Bus Traffic (bytes)" << std::setw(14) << "Write Backs"
+            << "\n";
+  for (size_t i = 0; i < protocols.size(); i++) {
+    const auto &summary = summaries.at(i);
+    std::cout << std::left << std::setw(10) << protocols.at(i) << std::right
+              << std::setw(18) << summary.execution_cycles << std::setw(22)
+              << summary.bus_traffic_bytes << std::setw(14)
+              << summary.write_backs << "\n";
+  }
+  std::cout << "---------------------------------------------" << std::endl;
 }
 
 int main(int argc, char **argv) {
@@ -109,189 +181,157 @@ int main(int argc, char **argv) {
     std::exit(1);
   }
 
-  const auto protocol = program.get<std::string>("protocol");
+  const auto protocols = parse_protocols(program.get<std::string>("protocol"));
   const auto path_str = program.get<std::string>("input_file");
   const auto cache_size = program.get<int>("cache_size");
   const auto associativity = program.get<int>("associativity");
   const auto block_size = program.get<int>("block_size");
-
-  std::cout << "Protocol: " << protocol << std::endl;
+  const auto stats_interval = program.get<int>("stats-interval");
+  const auto stats_output = program.get<std::string>("stats-output");
+  const auto profile = program.get<bool>("profile");
+  const auto profile_coherence = program.get<bool>("profile-coherence");
+  const auto synthetic_length = program.get<int64_t>("synthetic-length");
+  const auto synthetic_seed = program.get<int>("synthetic-seed");
+  const auto predecode = program.get<bool>("predecode");
+  const auto checkpoint_at = program.present<int>("checkpoint-at");
+  const auto checkpoint_output = program.get<std::string>("checkpoint-output");
+  const auto restore_from = program.present<std::string>("restore-from");
+  const auto num_threads = program.get<int>("threads");
+  const auto oversubscribe = program.get<bool>("oversubscribe");
+  const auto warmup = program.get<int64_t>("warmup");
+  const auto sample_interval = program.get<int64_t>("sample-interval");
+  const auto sample_window = program.get<int64_t>("sample-window");
+  const auto sample_warmup = program.get<int64_t>("sample-warmup");
+
+  std::cout << "Protocol: ";
+  for (size_t i = 0; i < protocols.size(); i++) {
+    std::cout << (i > 0 ? ", " : "") << protocols.at(i);
+  }
+  std::cout << std::endl;
   std::cout << "Input file: " << path_str << std::endl;
   std::cout << "Cache size: " << cache_size << " bytes" << std::endl;
   std::cout << "Associativity: " << associativity << std::endl;
   std::cout << "Block size: " << block_size << " bytes" << std::endl;
-
-  auto private_states =
-      protocol == SUPPORTED_PROTOCOLS.at(0)
-          ? std::vector<int>{static_cast<int>(MESIStatus::M),
-                             static_cast<int>(MESIStatus::E)}
-      : protocol == SUPPORTED_PROTOCOLS.at(1)
-          ? std::vector<int>{static_cast<int>(DragonStatus::M),
-                             static_cast<int>(DragonStatus::E)}
-      : protocol == SUPPORTED_PROTOCOLS.at(2)
-          ? std::vector<int>{static_cast<int>(MOESIStatus::M),
-                             static_cast<int>(MOESIStatus::E)}
-          : std::vector<int>{static_cast<int>(MESIFStatus::M),
-                             static_cast<int>(MESIFStatus::E)};
-
-  auto public_states =
-      protocol == SUPPORTED_PROTOCOLS.at(0)
-          ? std::vector<int>{static_cast<int>(MESIStatus::S)}
-      : protocol == SUPPORTED_PROTOCOLS.at(1)
-          ? std::vector<int>{static_cast<int>(DragonStatus::Sm),
-                             static_cast<int>(DragonStatus::Sc)}
-      : protocol == SUPPORTED_PROTOCOLS.at(2)
-          ? std::vector<int>(static_cast<int>(MOESIStatus::O),
-                             static_cast<int>(MOESIStatus::S))
-          : std::vector<int>{static_cast<int>(MESIFStatus::S),
-                             static_cast<int>(MESIFStatus::F)};
-
-  auto stats_accum = std::make_shared<StatisticsAccumulator>(
-      NUM_CORES, private_states, public_states);
-
-  auto traces = parse_traces(path_str);
-  // Register traces information
-  int i = 0;
-  for (auto &trace : traces) {
-
-    stats_accum->register_num_loads(
-        i, std::count_if(trace.begin(), trace.end(), [](const auto &instr) {
-          return instr.label == InstructionType::READ;
-        }));
-
-    stats_accum->register_num_stores(
-        i, std::count_if(trace.begin(), trace.end(), [](const auto &instr) {
-          return instr.label == InstructionType::WRITE;
-        }));
-
-    stats_accum->register_num_computes(
-        i, std::count_if(trace.begin(), trace.end(), [](const auto &instr) {
-          return instr.label == InstructionType::OTHER;
-        }));
-    i++;
+  if (stats_interval > 0) {
+    std::cout << "Stats interval: " << stats_interval << " cycles -> "
+              << stats_output << std::endl;
   }
 
-  // Create Bus
-  auto bus = std::make_shared<Bus>(NUM_CORES);
-
-  // Create Memory Controller
-  auto memory_controller = std::make_shared<MemoryController>(stats_accum);
-
-  // Create Cache Controllers and Processors
-  auto variant_caches_and_cores =
-      protocol == SUPPORTED_PROTOCOLS.at(0)
-          ? var_t{build_caches_and_cores<MESIProtocol>(
-                cache_size, associativity, block_size, bus, traces,
-                memory_controller, stats_accum)}
-      : protocol == SUPPORTED_PROTOCOLS.at(1)
-          ? var_t{build_caches_and_cores<DragonProtocol>(
-                cache_size, associativity, block_size, bus, traces,
-                memory_controller, stats_accum)}
-      : protocol == SUPPORTED_PROTOCOLS.at(2)
-          ? var_t{build_caches_and_cores<MOESIProtocol>(
-                cache_size, associativity, block_size, bus, traces,
-                memory_controller, stats_accum)}
-          : var_t{build_caches_and_cores<MESIFProtocol>(
-                cache_size, associativity, block_size, bus, traces,
-                memory_controller, stats_accum)};
-  ;
-
-  // Initialise memory controller delay
-  const auto num_words_per_line = std::visit(
-      [](auto &&arg) -> int {
-        return std::get<0>(arg).at(0)->cache.num_words_per_line;
-      },
-      variant_caches_and_cores);
-  memory_controller->set_delay(2 * num_words_per_line);
-
-  // Run simulation
-  int cycle = -1;
-  std::vector<int> cycle_completions(NUM_CORES, -1);
-
-  std::cout << std::endl;
-  std::cout
-      << "-------------------------SIMULATION BEGIN-------------------------"
-      << std::endl;
-
-  auto rng = std::default_random_engine{};
+  if (checkpoint_at && checkpoint_at.value() >= MAX_SIMULATED_CYCLE) {
+    std::cerr << "--checkpoint-at must be below " << MAX_SIMULATED_CYCLE
+              << ", the most a run can simulate!" << std::endl;
+    std::exit(1);
+  }
 
-  while (std::visit(
-      [](auto &&arg) -> bool {
-        auto cores = std::get<1>(arg);
-        return std::any_of(cores.begin(), cores.end(),
-                           [](auto &core) { return !core->is_done(); });
-      },
-      variant_caches_and_cores)) {
-    cycle++;
-    memory_controller->run_once();
-    bus->reset();
+  if (protocols.size() > 1 &&
+      (checkpoint_at || restore_from || stats_interval > 0)) {
+    std::cerr << "Checkpoints and --stats-interval need a single protocol!"
+              << std::endl;
+    std::exit(1);
+  }
 
-    // Run each core once
-    std::visit(
-        [cycle, stats_accum](auto &&arg) {
-          auto cores = std::get<1>(arg);
-          std::for_each(
-              cores.begin(), cores.end(), [cycle, stats_accum](auto &core) {
-                core->run_once(cycle);
-                if (core->is_done()) {
-                  stats_accum->on_run_end(core->get_processor_id(), cycle);
-                }
-              });
-        },
-        variant_caches_and_cores);
+  auto sampling = std::optional<SamplingConfig>{};
+  if (sample_interval > 0) {
+    if (sample_window <= 0 || sample_window > sample_interval) {
+      std::cerr << "--sample-window must be between 1 and --sample-interval!"
+                << std::endl;
+      std::exit(1);
+    }
+    if (sample_warmup < 0 || sample_warmup > sample_interval - sample_window) {
+      std::cerr << "--sample-warmup must be between 0 and --sample-interval "
+                << "minus --sample-window!" << std::endl;
+      std::exit(1);
+    }
+    if (checkpoint_at || restore_from || stats_interval > 0) {
+      std::cerr << "--sample-interval cannot be combined with checkpoints or "
+                << "--stats-interval!" << std::endl;
+      std::exit(1);
+    }
+    sampling = SamplingConfig{static_cast<uint64_t>(sample_interval),
+                              static_cast<uint64_t>(sample_window),
+                              static_cast<uint64_t>(sample_warmup)};
+    std::cout << "Sampling: " << sample_window << " of every "
+              << sample_interval << " accesses per core in detail, after "
+              << sample_warmup << " unmeasured" << std::endl;
+  }
 
-#ifdef DEBUG_FLAG
-    // Print each cache's content
-    std::visit(
-        [](auto &&arg) {
-          auto caches = std::get<0>(arg);
-          std::for_each(caches.begin(), caches.end(), [](auto &cache) {
-            cache->get_interesting_cache_lines();
-          });
-        },
-        variant_caches_and_cores);
-#endif
+  const auto geometry = address_geometry(cache_size, associativity, block_size);
+  auto trace_sources = TraceSources{};
+  auto traces = std::optional<SharedTraces>{};
+  auto trace_identity = TraceIdentity{};
+  if (const auto pattern = parse_synthetic_input(path_str)) {
+    auto workload_config = WorkloadConfig{};
+    workload_config.pattern = pattern.value();
+    workload_config.seed = static_cast<uint64_t>(synthetic_seed);
+    workload_config.block_size = block_size;
+    std::cout << "Running synthetic benchmark: " << to_string(pattern.value())
+              << " (" << synthetic_length << " instructions per core, seed "
+              << synthetic_seed << ")" << std::endl;
+    trace_sources = make_synthetic_sources(workload_config,
+                                           synthetic_length);
+    trace_identity =
+        synthetic_trace_identity(workload_config, synthetic_length);
+  } else {
+    if (predecode && !profile) {
+      traces = load_decoded_trace_files(path_str, geometry);
+    } else {
+      trace_sources = open_trace_files(path_str);
+    }
+    trace_identity = trace_file_identity(path_str);
+  }
 
-    if (cycle % PRINT_INTERVAL == 0) {
-      std::cout << "Cycle: " << (cycle / PRINT_INTERVAL) << UNIT << std::endl;
-      std::visit(
-          [](auto &&arg) {
-            auto cores = std::get<1>(arg);
-            std::for_each(cores.begin(), cores.end(), [](auto &core) {
-              std::cout << "\tCore " << core->get_processor_id() << ": "
-                        << core->progress() << "%" << std::endl;
-            });
-          },
-          variant_caches_and_cores);
+  if (profile) {
+    // Single-pass miss-ratio curves; no timing simulation
+    auto traces = std::array<std::vector<Instruction>, NUM_CORES>{};
+    for (int i = 0; i < NUM_CORES; i++) {
+      traces.at(i) = drain(*trace_sources.at(i));
     }
+    auto profiler = StackDistanceProfiler{block_size, profile_coherence};
+    profiler.profile(traces);
+    std::cout << profiler << std::endl;
+    return 0;
   }
-  std::cout << std::endl;
-  std::cout
-      << "-------------------------SIMULATION END-------------------------"
-      << std::endl;
 
-  std::cout << std::endl;
-  std::cout << "-------------------------CACHE CONTENT-------------------------"
-            << std::endl;
-  std::visit(
-      [](auto &&arg) {
-        auto cores = std::get<1>(arg);
-        std::for_each(cores.begin(), cores.end(),
-                      [](auto &&core) { core->get_interesting_cache_lines(); });
-      },
-      variant_caches_and_cores);
-  std::cout << "-------------------------CACHE END-------------------------"
-            << std::endl;
+  const auto config = SystemConfig{cache_size, associativity, block_size};
+  const auto options =
+      RunOptions{protocols.at(0), stats_interval,    stats_output,
+                 checkpoint_at,   checkpoint_output, restore_from,
+                 trace_identity,  num_threads,       oversubscribe,
+                 warmup,          sampling};
+  if (!traces && (predecode || protocols.size() > 1)) {
+    // Every protocol simulates the same geometry, so one decode serves all
+    traces = load_traces(trace_sources, geometry);
+  }
+  if (protocols.size() == 1) {
+    simulate(protocols.at(0), config,
+             traces ? make_shared_sources(traces.value())
+                    : std::move(trace_sources),
+             options, std::cout);
+    return 0;
+  }
 
-  std::cout << *stats_accum << std::endl;
+  // Run one pipeline per protocol over the traces read above. Each report is
+  // buffered so that the output does not interleave.
+  auto outputs = std::vector<std::ostringstream>(protocols.size());
+  auto summaries = std::vector<RunSummary>(protocols.size());
+  auto pipelines = std::vector<std::thread>{};
+  for (size_t i = 0; i < protocols.size(); i++) {
+    pipelines.emplace_back([&, i]() {
+      summaries.at(i) = simulate(protocols.at(i), config,
+                                 make_shared_sources(traces.value()), options,
+                                 outputs.at(i));
+    });
+  }
+  for (auto &pipeline : pipelines) {
+    pipeline.join();
+  }
 
-  std::visit(
-      [](auto &&arg) {
-        auto cache_controllers = std::get<0>(arg);
-        std::for_each(cache_controllers.begin(), cache_controllers.end(),
-                      [](auto &&cc) { cc->deregister_cache_controllers(); });
-      },
-      variant_caches_and_cores);
+  for (size_t i = 0; i < protocols.size(); i++) {
+    std::cout << "=========================" << protocols.at(i)
+              << "=========================" << std::endl;
+    std::cout << outputs.at(i).str();
+  }
+  print_comparison(protocols, summaries);
 
   return 0;
 }
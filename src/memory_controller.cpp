@@ -18,10 +18,16 @@ auto MemoryController::is_done() -> bool {
 #endif
 }
 
+auto MemoryController::is_idle() -> bool {
+  return !pending_write_back && !pending_data_read && write_buffer.is_empty();
+}
+
 auto MemoryController::run_once() -> void {
+  cycle += 1;
+
 #ifdef USE_WRITE_BUFFER
-  if (write_buffer.run_once()) {
-    stats_accum->on_write_back();
+  if (auto address = write_buffer.run_once()) {
+    stats_accum->on_write_back(address.value());
   };
 #endif
 
@@ -52,14 +58,34 @@ auto MemoryController::read_data(uint32_t address) -> bool {
 #endif
 }
 
+void MemoryController::save(CheckpointWriter &writer) const {
+  write_buffer.save(writer);
+  writer.write(pending_write_back);
+  writer.write(pending_data_read);
+  writer.write(delay);
+  writer.write(cycle);
+  writer.write(write_back_start_cycle);
+}
+
+void MemoryController::restore(CheckpointReader &reader) {
+  write_buffer.restore(reader);
+  reader.read(pending_write_back);
+  reader.read(pending_data_read);
+  reader.read(delay);
+  reader.read(cycle);
+  reader.read(write_back_start_cycle);
+}
+
 #ifdef USE_WRITE_BUFFER
 auto MemoryController::write_back_with_write_buffer(uint32_t address) -> bool {
   if (!pending_write_back) {
     pending_write_back = delay - 1;
+    write_back_start_cycle = cycle;
     return false;
   } else if (pending_write_back && pending_write_back.value() == 0) {
     pending_write_back = std::nullopt;
     write_buffer.add_to_queue(address);
+    stats_accum->on_write_back_stall(cycle - write_back_start_cycle + 1);
     return true;
   } else {
     return false;
@@ -85,10 +111,12 @@ auto MemoryController::read_data_with_write_buffer(uint32_t address) -> bool {
 auto MemoryController::simple_write_back(uint32_t address) -> bool {
   if (!pending_write_back) {
     pending_write_back = MEMORY_MISS_PENALTY - 1;
+    write_back_start_cycle = cycle;
     return false;
   } else if (pending_write_back && pending_write_back.value() == 0) {
     pending_write_back = std::nullopt;
-    stats_accum->on_write_back();
+    stats_accum->on_write_back(address);
+    stats_accum->on_write_back_stall(cycle - write_back_start_cycle + 1);
     return true;
   } else {
     return false;
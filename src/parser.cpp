@@ -1,9 +1,38 @@
 #include "parser.hpp"
 #include "argparse/argparse.hpp"
+#include "trace_source.hpp"
 
 #include <filesystem>
 #include <sstream>
 
+auto parse_protocols(const std::string &value) -> std::vector<std::string> {
+  if (value == ALL_PROTOCOLS) {
+    return SUPPORTED_PROTOCOLS;
+  }
+
+  auto protocols = std::vector<std::string>{};
+  auto ss = std::stringstream{value};
+  auto protocol = std::string{};
+  while (std::getline(ss, protocol, ',')) {
+    if (std::find(SUPPORTED_PROTOCOLS.begin(), SUPPORTED_PROTOCOLS.end(),
+                  protocol) == SUPPORTED_PROTOCOLS.end()) {
+      std::stringstream error;
+      error << "Invalid protocol: " << protocol << std::endl;
+      throw std::runtime_error{error.str()};
+    }
+    if (std::find(protocols.begin(), protocols.end(), protocol) ==
+        protocols.end()) {
+      protocols.push_back(protocol);
+    }
+  }
+  if (protocols.empty()) {
+    std::stringstream error;
+    error << "Invalid protocol: " << value << std::endl;
+    throw std::runtime_error{error.str()};
+  }
+  return protocols;
+}
+
 auto parser() -> argparse::ArgumentParser {
   argparse::ArgumentParser program{"Cache Simulator"};
 
@@ -16,23 +45,24 @@ auto parser() -> argparse::ArgumentParser {
       ss << ", ";
     }
   }
-  ss << "]";
+  ss << "], a comma-separated list of them, or " << ALL_PROTOCOLS
+     << " to compare them on the same trace";
 
   program.add_argument("protocol")
       .help(ss.str())
       .action([](const std::string &value) {
-        if (std::find(SUPPORTED_PROTOCOLS.begin(), SUPPORTED_PROTOCOLS.end(),
-                      value) != SUPPORTED_PROTOCOLS.end()) {
-          return value;
-        }
-        std::stringstream ss;
-        ss << "Invalid protocol: " << value << std::endl;
-        throw std::runtime_error{ss.str()};
+        parse_protocols(value);
+        return value;
       });
 
   program.add_argument("input_file")
-      .help("Input benchmark name. Must be in the current directory")
+      .help("Input benchmark name. Must be in the current directory. Or "
+            "synthetic:<pattern> to generate the traces on the fly (see "
+            "tracegen for the patterns)")
       .action([](const std::string &value) {
+        if (parse_synthetic_input(value)) {
+          return value;
+        }
         auto dirpath = std::filesystem::path{value};
         if (!std::filesystem::exists(dirpath)) {
           std::stringstream ss;
@@ -63,5 +93,93 @@ auto parser() -> argparse::ArgumentParser {
       .default_value(32)
       .scan<'d', int>()
       .help("Block size (bytes)");
+
+  program.add_argument("--stats-interval")
+      .default_value(0)
+      .scan<'d', int>()
+      .help("Sample per-core statistics every N cycles (0 to disable)");
+
+  program.add_argument("--stats-output")
+      .default_value(std::string{"stats_intervals.csv"})
+      .help("Output CSV file for interval statistics");
+
+  program.add_argument("--profile")
+      .default_value(false)
+      .implicit_value(true)
+      .help("Print LRU stack-distance miss-ratio curves instead of "
+            "simulating");
+
+  program.add_argument("--profile-coherence")
+      .default_value(false)
+      .implicit_value(true)
+      .help("Fold writes from other cores into the profile as "
+            "invalidations");
+
+  program.add_argument("--synthetic-length")
+      .default_value(int64_t{1000000})
+      .scan<'d', int64_t>()
+      .help("Instructions per core of a synthetic input");
+
+  program.add_argument("--synthetic-seed")
+      .default_value(1)
+      .scan<'d', int>()
+      .help("Random seed of a synthetic input");
+
+  program.add_argument("--predecode")
+      .default_value(false)
+      .implicit_value(true)
+      .help("Load the traces into memory with their addresses split for the "
+            "cache geometry, cached next to binary trace files");
+
+  program.add_argument("--threads")
+      .default_value(1)
+      .scan<'d', int>()
+      .help("Simulate the cores on up to N threads, synchronised at bus "
+            "accesses; the results do not depend on N");
+
+  program.add_argument("--oversubscribe")
+      .default_value(false)
+      .implicit_value(true)
+      .help("Use up to --threads threads even on fewer hardware threads");
+
+  program.add_argument("--warmup")
+      .default_value(int64_t{0})
+      .scan<'d', int64_t>()
+      .help("Warm the caches up functionally with the first N memory accesses "
+            "of each core; statistics cover the rest of the trace");
+
+  program.add_argument("--sample-interval")
+      .default_value(int64_t{0})
+      .scan<'d', int64_t>()
+      .help("Estimate the results by measuring only the last "
+            "--sample-window of every N memory accesses of each core in "
+            "detail, and simulating all but the --sample-warmup before them "
+            "functionally (0 to disable)");
+
+  program.add_argument("--sample-window")
+      .default_value(int64_t{1000})
+      .scan<'d', int64_t>()
+      .help("Memory accesses per core of each detailed window of "
+            "--sample-interval");
+
+  program.add_argument("--sample-warmup")
+      .default_value(int64_t{1000})
+      .scan<'d', int64_t>()
+      .help("Memory accesses per core simulated in detail but not measured "
+            "before each --sample-window");
+
+  program.add_argument("--checkpoint-at")
+      .scan<'d', int>()
+      .help("Save the simulator state at the end of this cycle, or of the "
+            "first later one with no bus transaction in progress, then carry "
+            "on");
+
+  program.add_argument("--checkpoint-output")
+      .default_value(std::string{"checkpoint.bin"})
+      .help("Output file for --checkpoint-at");
+
+  program.add_argument("--restore-from")
+      .help("Resume from a checkpoint taken with the same protocol, cache "
+            "configuration and input");
   return program;
 }
\ No newline at end of file
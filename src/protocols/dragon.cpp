@@ -7,7 +7,6 @@
 
 #include <algorithm>
 #include <memory>
-#include <numeric>
 #include <optional>
 
 auto to_string(const DragonStatus &status) -> std::string {
@@ -28,390 +27,216 @@ auto to_string(const DragonStatus &status) -> std::string {
 }
 
 template <>
-auto DragonProtocol::handle_read_miss(
-    int controller_id, int32_t curr_cycle, ParsedAddress parsed_address,
-    std::vector<std::shared_ptr<CacheController<DragonProtocol>>>
-        &cache_controllers,
-    std::shared_ptr<Bus> bus, std::shared_ptr<CacheLine<Status>> line,
-    std::shared_ptr<MemoryController> memory_controller,
-    std::shared_ptr<StatisticsAccumulator> stats_accum) -> Instruction {
-  const auto instruction =
-      Instruction{InstructionType::READ, std::nullopt, parsed_address.address};
-  if (!bus->acquire(controller_id)) {
-    return instruction;
-  }
-
+auto DragonProtocol::handle_read_miss(int controller_id, int32_t curr_cycle,
+                                      ParsedAddress parsed_address,
+                                      CacheLine<Status> *line,
+                                      const Context &context) -> Task {
 #ifdef DEBUG_FLAG
   std::stringstream ss;
   ss << "Cycle: " << curr_cycle << "\n"
      << "Processor " << controller_id << " requests READ at address "
-     << parsed_address.address << "\n\tLine: " << to_string(line) << "\n\t>>> "
-     << to_string(line) << std::endl;
+     << parsed_address.address << "\n\tLine: " << to_string(*line) << "\n\t>>> "
+     << to_string(*line) << std::endl;
   std::cout << ss.str();
 #endif
 
-  if (((line->status == DragonStatus::M || line->status == DragonStatus::Sm) &&
-       bus->already_flush == false)) {
+  if (line->status == DragonStatus::M || line->status == DragonStatus::Sm) {
     // Write-back to Memory
-    if (memory_controller->write_back(parsed_address.address)) {
-      // Write-back completed! Invalidate the line so that the next time it is
-      // called, it goes back to read-miss
+    const auto victim_address =
+        context.cache_controllers.at(controller_id)->cache.line_address(*line);
+    curr_cycle =
+        co_await context.memory_controller->await_write_back(victim_address);
 #ifdef DEBUG_FLAG
-      std::cout << "\t<<<Finish writing LRU to memory" << std::endl;
+    std::cout << "\t<<<Finish writing LRU to memory" << std::endl;
 #endif
-      // Set already_flush to true so that the next time it is called, it does
-      // not write-back again
-      stats_accum->on_bus_traffic(
-          cache_controllers.at(controller_id)->cache.num_words_per_line);
-      bus->already_flush = true;
-    } else {
-#ifdef DEBUG_FLAG
-      std::cout << "\t<<<Writing LRU to memory" << std::endl;
-#endif
-      // Write-back is not done
-      return instruction;
-    }
+    context.stats_accum->on_bus_traffic(
+        controller_id,
+        victim_address,
+        context.cache_controllers.at(controller_id)->cache.num_words_per_line);
   }
 
-  // Send BusRd request
+  // Send BusRd request and wait for the other caches to respond
   const auto request =
       BusRequest{BusRequestType::BusRd, parsed_address.address, controller_id};
-  bus->request_queue = request;
-
-  // Get responses from other caches
-  for (auto cache_controller : cache_controllers) {
-    cache_controller->receive_bus_request();
-  }
-
-  // Check if any of the response is a PENDING response
-  bool is_waiting = false;
-  for (auto i = 0; i < NUM_CORES; i++) {
-    if (bus->response_wait_bits.at(i) == true) {
-      is_waiting = true;
-
-      // Reset the pending cache's information
-      bus->response_completed_bits.at(i) = false;
-      break;
-    }
-  }
-
-  if (is_waiting) {
-#ifdef DEBUG_FLAG
-    std::cout << "\t<<< Waiting for Cache..." << std::endl;
-#endif
-    // We are waiting for another cache to respond -> cannot process instruction
-    // -> return the same instruction
-    return instruction;
-  }
+  curr_cycle = co_await until([&](int32_t cycle) {
+    return collect_responses(request, cycle, context);
+  });
 
   // Read response
-  auto is_shared =
-      std::reduce(bus->response_is_present_bits.begin(),
-                  bus->response_is_present_bits.end(), false,
-                  [](bool acc, bool is_present) { return acc || is_present; });
+  auto is_shared = context.bus->response_is_present_bits.any();
 
-  // Invalidate all responses lmao do i invalidate??
-  std::for_each(bus->response_completed_bits.begin(),
-                bus->response_completed_bits.end(),
-                [](auto &&valid_bit) { valid_bit = false; });
+  // Invalidate all responses
+  context.bus->response_completed_bits.reset();
 
   if (!is_shared) {
     // Miss: Go to memory controller
-    if (memory_controller->read_data(parsed_address.address)) {
-      // Memory-to-cache transfer completed ->  Update cache line
-      line->tag = parsed_address.tag;
-      line->last_used = curr_cycle;
-      line->status = DragonStatus::E;
-#ifdef DEBUG_FLAG
-      std::cout << "\t<<< " << to_string(line) << std::endl;
-#endif
-      stats_accum->on_bus_traffic(
-          cache_controllers.at(controller_id)->cache.num_words_per_line);
-      bus->release(controller_id);
-      return Instruction{InstructionType::OTHER, 0, std::nullopt};
-    } else {
+    curr_cycle = co_await context.memory_controller->await_read_data(
+        parsed_address.address);
+
+    // Memory-to-cache transfer completed ->  Update cache line
+    line->tag = parsed_address.tag;
+    line->last_used = curr_cycle;
+    line->status = DragonStatus::E;
 #ifdef DEBUG_FLAG
-      std::cout << "\t<<< Waiting for Memory..." << std::endl;
+    std::cout << "\t<<< " << to_string(*line) << std::endl;
 #endif
-
-      return instruction;
-    }
+    context.stats_accum->on_bus_traffic(
+        controller_id,
+        parsed_address.address,
+        context.cache_controllers.at(controller_id)->cache.num_words_per_line);
+    context.bus->release(controller_id);
+    co_return Instruction{InstructionType::OTHER, 0, std::nullopt};
   } else {
     // Cache-to-cache transfer completed -> Update cache line
+    context.stats_accum->on_cache_to_cache_transfer(controller_id);
     line->tag = parsed_address.tag;
     line->last_used = curr_cycle;
     line->status = DragonStatus::Sc;
 #ifdef DEBUG_FLAG
-    std::cout << "\t<<< " << to_string(line) << std::endl;
+    std::cout << "\t<<< " << to_string(*line) << std::endl;
 #endif
 
-    stats_accum->on_bus_traffic(
-        cache_controllers.at(controller_id)->cache.num_words_per_line);
-    bus->release(controller_id);
-    return Instruction{InstructionType::OTHER, 0, std::nullopt};
+    context.stats_accum->on_bus_traffic(
+        controller_id,
+        parsed_address.address,
+        context.cache_controllers.at(controller_id)->cache.num_words_per_line);
+    context.bus->release(controller_id);
+    co_return Instruction{InstructionType::OTHER, 0, std::nullopt};
   }
 }
 
 template <>
-auto DragonProtocol::handle_write_miss(
-    int controller_id, int32_t curr_cycle, ParsedAddress parsed_address,
-    std::vector<std::shared_ptr<CacheController<DragonProtocol>>>
-        &cache_controllers,
-    std::shared_ptr<Bus> bus, std::shared_ptr<CacheLine<Status>> line,
-    std::shared_ptr<MemoryController> memory_controller,
-    std::shared_ptr<StatisticsAccumulator> stats_accum) -> Instruction {
-  const auto instruction =
-      Instruction{InstructionType::WRITE, std::nullopt, parsed_address.address};
-
-  if (!bus->acquire(controller_id)) {
-    return instruction;
-  }
-
+auto DragonProtocol::handle_write_miss(int controller_id, int32_t curr_cycle,
+                                       ParsedAddress parsed_address,
+                                       CacheLine<Status> *line,
+                                       const Context &context) -> Task {
 #ifdef DEBUG_FLAG
   std::stringstream ss;
   ss << "Cycle: " << curr_cycle << "\n"
      << "Processor " << controller_id << " requests WRITE at address "
-     << parsed_address.address << "\n\tLine: " << to_string(line) << "\n\t>>> "
-     << to_string(line) << std::endl;
+     << parsed_address.address << "\n\tLine: " << to_string(*line) << "\n\t>>> "
+     << to_string(*line) << std::endl;
   std::cout << ss.str();
 #endif
 
-  if (((line->status == DragonStatus::M || line->status == DragonStatus::Sm) &&
-       bus->already_flush == false)) {
+  if (line->status == DragonStatus::M || line->status == DragonStatus::Sm) {
     // Write-back to Memory
     const auto request = BusRequest{BusRequestType::Flush,
                                     parsed_address.address, controller_id};
-    bus->request_queue = request;
-    if (memory_controller->write_back(parsed_address.address)) {
-      // Write-back completed!
+    context.bus->request_queue = request;
+    const auto victim_address =
+        context.cache_controllers.at(controller_id)->cache.line_address(*line);
+    curr_cycle =
+        co_await context.memory_controller->await_write_back(victim_address);
 #ifdef DEBUG_FLAG
-      std::cout << "\t<<<Finish writing LRU to memory" << std::endl;
+    std::cout << "\t<<<Finish writing LRU to memory" << std::endl;
 #endif
-      // Set already_flush to true so that the next time it is called, it does
-      // not write-back again
-      bus->already_flush = true;
-      stats_accum->on_bus_traffic(
-          cache_controllers.at(controller_id)->cache.num_words_per_line);
-    } else {
-#ifdef DEBUG_FLAG
-      std::cout << "\t<<<Writing LRU to memory" << std::endl;
-#endif
-      // Write-back is not done
-      return instruction;
-    }
+    context.stats_accum->on_bus_traffic(
+        controller_id,
+        victim_address,
+        context.cache_controllers.at(controller_id)->cache.num_words_per_line);
   }
 
-  if (!bus->already_busrd) {
-    // See if any other cache has the data
-    auto read_request = BusRequest{BusRequestType::BusRd,
-                                   parsed_address.address, controller_id};
-    bus->request_queue = read_request;
-
-    // Get responses from other caches
-    for (auto cache_controller : cache_controllers) {
-      cache_controller->receive_bus_request();
-    }
-
-    // Check if any of the response is a PENDING response
-    bool is_waiting = false;
-    for (auto i = 0; i < NUM_CORES; i++) {
-      if (bus->response_wait_bits.at(i) == true) {
-        is_waiting = true;
-
-        // Reset the pending cache's information
-        bus->response_completed_bits.at(i) = false;
-        break;
-      }
-    }
-    if (is_waiting) {
-#ifdef DEBUG_FLAG
-      std::cout << "\t<<< Waiting for Cache to BusRd ..." << std::endl;
-#endif
-      // We are waiting for another cache to respond -> cannot process
-      // instruction
-      // -> return the same instruction
-      return instruction;
-    } else {
+  // See if any other cache has the data
+  auto read_request = BusRequest{BusRequestType::BusRd,
+                                 parsed_address.address, controller_id};
+  curr_cycle = co_await until([&](int32_t cycle) {
+    return collect_responses(read_request, cycle, context);
+  });
 #ifdef DEBUG_FLAG
-      std::cout << "\t<<< Cache BusRd completed ..." << std::endl;
+  std::cout << "\t<<< Cache BusRd completed ..." << std::endl;
 #endif
-      // Cache-to-cache transfer completed
-      bus->already_busrd = true;
-    }
-  }
 
   // Invariant: When this point is reached, this cache knows if shared or not
   // shared
 
   // Read response
-  auto is_shared =
-      std::reduce(bus->response_is_present_bits.begin(),
-                  bus->response_is_present_bits.end(), false,
-                  [](bool acc, bool is_present) { return acc || is_present; });
+  auto is_shared = context.bus->response_is_present_bits.any();
 
   // Invalidate all responses
-  std::for_each(bus->response_completed_bits.begin(),
-                bus->response_completed_bits.end(),
-                [](auto &&valid_bit) { valid_bit = false; });
+  context.bus->response_completed_bits.reset();
 
   if (!is_shared) {
     // Not shared -> Go to memory controller
-    if (memory_controller->read_data(parsed_address.address)) {
-      // Memory-to-cache transfer completed -> Update cache line
-      line->tag = parsed_address.tag;
-      line->last_used = curr_cycle;
-      line->status = DragonStatus::M;
-#ifdef DEBUG_FLAG
-      std::cout << "\t<<< " << to_string(line) << std::endl;
-#endif
-      stats_accum->on_bus_traffic(
-          cache_controllers.at(controller_id)->cache.num_words_per_line);
-      bus->release(controller_id);
-      return Instruction{InstructionType::OTHER, 0, std::nullopt};
-    } else {
+    curr_cycle = co_await context.memory_controller->await_read_data(
+        parsed_address.address);
+
+    // Memory-to-cache transfer completed -> Update cache line
+    line->tag = parsed_address.tag;
+    line->last_used = curr_cycle;
+    line->status = DragonStatus::M;
 #ifdef DEBUG_FLAG
-      std::cout << "\t<<< Waiting for Memory..." << std::endl;
+    std::cout << "\t<<< " << to_string(*line) << std::endl;
 #endif
-      return instruction;
-    }
+    context.stats_accum->on_bus_traffic(
+        controller_id,
+        parsed_address.address,
+        context.cache_controllers.at(controller_id)->cache.num_words_per_line);
+    context.bus->release(controller_id);
+    co_return Instruction{InstructionType::OTHER, 0, std::nullopt};
   }
 
-  // Invariant: Cache definitely has the data and is shared -> send BusUpd
-  stats_accum->on_bus_traffic(
-      cache_controllers.at(controller_id)->cache.num_words_per_line);
-
+  // Invariant: Cache definitely has the data and is shared -> send BusUpd.
+  // Every try clears the responses and counts the line as bus traffic again
   auto request =
       BusRequest{BusRequestType::BusUpd, parsed_address.address, controller_id};
-
-  bus->request_queue = request;
-
-  // Wait for response
-  for (auto cache_controller : cache_controllers) {
-    cache_controller->receive_bus_request();
-  }
-
-  // Check if any of the response is a PENDING response
-  bool is_waiting = false;
-  for (auto i = 0; i < NUM_CORES; i++) {
-    if (bus->response_wait_bits.at(i) == true) {
-      is_waiting = true;
-
-      // Reset the pending cache's information
-      bus->response_completed_bits.at(i) = false;
-      break;
-    }
-  }
-  if (is_waiting) {
-#ifdef DEBUG_FLAG
-    std::cout << "\t<<< Waiting for Cache..." << std::endl;
-#endif
-    // We are waiting for another cache to respond -> cannot process
-    // instruction
-    // -> return the same instruction
-    return instruction;
-  }
+  curr_cycle = co_await until([&](int32_t cycle) {
+    context.bus->response_completed_bits.reset();
+    context.stats_accum->on_bus_traffic(
+        controller_id,
+        parsed_address.address,
+        context.cache_controllers.at(controller_id)->cache.num_words_per_line);
+    return collect_responses(request, cycle, context);
+  });
 
   // Invalidate all responses
-  std::for_each(bus->response_completed_bits.begin(),
-                bus->response_completed_bits.end(),
-                [](auto &&valid_bit) { valid_bit = false; });
+  context.bus->response_completed_bits.reset();
 
+  context.stats_accum->on_cache_to_cache_transfer(controller_id);
   line->tag = parsed_address.tag;
   line->last_used = curr_cycle;
   line->status = DragonStatus::Sm;
 #ifdef DEBUG_FLAG
-  std::cout << "\t<<< " << to_string(line) << std::endl;
+  std::cout << "\t<<< " << to_string(*line) << std::endl;
 #endif
-  bus->release(controller_id);
-  stats_accum->on_bus_traffic(1);
-  return Instruction{InstructionType::OTHER, 0, std::nullopt};
-}
-
-template <>
-auto DragonProtocol::handle_read_hit(
-    int controller_id, int32_t, ParsedAddress parsed_address,
-    std::vector<std::shared_ptr<CacheController<DragonProtocol>>> &,
-    std::shared_ptr<Bus> bus, std::shared_ptr<CacheLine<Status>>,
-    std::shared_ptr<MemoryController>,
-    std::shared_ptr<StatisticsAccumulator> stats_accum) -> Instruction {
-  // Optimisation: allow read hits to be processed without acquiring the bus
-  return Instruction{InstructionType::OTHER, 0, std::nullopt};
+  context.bus->release(controller_id);
+  context.stats_accum->on_bus_traffic(controller_id, parsed_address.address, 1);
+  co_return Instruction{InstructionType::OTHER, 0, std::nullopt};
 }
 
 template <>
-auto DragonProtocol::handle_write_hit(
-    int controller_id, int32_t curr_cycle, ParsedAddress parsed_address,
-    std::vector<std::shared_ptr<CacheController<DragonProtocol>>>
-        &cache_controllers,
-    std::shared_ptr<Bus> bus, std::shared_ptr<CacheLine<Status>> line,
-    std::shared_ptr<MemoryController> memory_controller,
-    std::shared_ptr<StatisticsAccumulator> stats_accum) -> Instruction {
+auto DragonProtocol::handle_write_hit(int controller_id, int32_t curr_cycle,
+                                      ParsedAddress parsed_address,
+                                      CacheLine<Status> *line,
+                                      const Context &context) -> Task {
   const auto instruction =
       Instruction{InstructionType::WRITE, std::nullopt, parsed_address.address};
-  // try and acquire bus
-  if (!bus->acquire(controller_id)) {
-    return instruction;
-  }
 
+  // M and E are handled by handle_local_write_hit()
   switch (line->status) {
-  case DragonStatus::M: {
-    bus->release(controller_id);
-    return Instruction{InstructionType::OTHER, 0, std::nullopt};
-  }
-  case DragonStatus::E: {
-    line->status = DragonStatus::M;
-    bus->release(controller_id);
-    return Instruction{InstructionType::OTHER, 0, std::nullopt};
-  }
   case DragonStatus::I: {
     // Impossible!
-    return instruction;
+    co_return instruction;
   }
   default: {
 #ifdef DEBUG_FLAG
     std::stringstream ss;
     ss << "Cycle: " << curr_cycle << "\n"
        << "Processor " << controller_id << " requests SHARED WRITE at address "
-       << parsed_address.address << "\n\tLine: " << to_string(line)
-       << "\n\t>>> " << to_string(line) << std::endl;
+       << parsed_address.address << "\n\tLine: " << to_string(*line)
+       << "\n\t>>> " << to_string(*line) << std::endl;
     std::cout << ss.str();
 #endif
 
-    // Send BusUpd request
+    // Send BusUpd request and wait for the other caches to respond
     auto request = BusRequest{BusRequestType::BusUpd, parsed_address.address,
                               controller_id};
-    bus->request_queue = request;
-
-    // Wait for response
-    for (auto cache_controller : cache_controllers) {
-      cache_controller->receive_bus_request();
-    }
-
-    // Check if any of the response is a PENDING response
-    bool is_waiting = false;
-    for (auto i = 0; i < NUM_CORES; i++) {
-      if (bus->response_wait_bits.at(i) == true) {
-        is_waiting = true;
-
-        // Reset the pending cache's information
-        bus->response_completed_bits.at(i) = false;
-        break;
-      }
-    }
-
-    if (is_waiting) {
-#ifdef DEBUG_FLAG
-      std::cout << "\t<<< Waiting for Cache..." << std::endl;
-#endif
-      // We are waiting for another cache to respond -> cannot process
-      // instruction -> return the same instruction
-      return instruction;
-    }
+    curr_cycle = co_await until([&](int32_t cycle) {
+      return collect_responses(request, cycle, context);
+    });
 
     // clear bus
-    std::for_each(bus->response_completed_bits.begin(),
-                  bus->response_completed_bits.end(),
-                  [](auto &&valid_bit) { valid_bit = false; });
+    context.bus->response_completed_bits.reset();
 
     // Update cache line
     line->tag = parsed_address.tag;
@@ -419,19 +244,19 @@ auto DragonProtocol::handle_write_hit(
     line->status = DragonStatus::Sm;
 
 #ifdef DEBUG_FLAG
-    std::cout << "\t<<< " << to_string(line) << std::endl;
+    std::cout << "\t<<< " << to_string(*line) << std::endl;
 #endif
-    bus->release(controller_id);
-    stats_accum->on_bus_traffic(1);
-    return Instruction{InstructionType::OTHER, 0, std::nullopt};
+    context.bus->release(controller_id);
+    context.stats_accum->on_bus_traffic(controller_id, parsed_address.address,
+                                        1);
+    co_return Instruction{InstructionType::OTHER, 0, std::nullopt};
   }
   }
 }
 
 template <>
-auto DragonProtocol::state_transition(
-    const BusRequest &request, std::shared_ptr<CacheLine<DragonStatus>> line)
-    -> void {
+auto DragonProtocol::state_transition(const BusRequest &request,
+                                      CacheLine<DragonStatus> *line) -> void {
   switch (request.type) {
   case BusRequestType::BusRd: {
     // Read request
@@ -483,14 +308,11 @@ auto DragonProtocol::state_transition(
 }
 
 template <>
-auto DragonProtocol::handle_bus_request(
-    const BusRequest &request, std::shared_ptr<Bus> bus, int32_t controller_id,
-    std::shared_ptr<std::tuple<BusRequest, int32_t>> pending_bus_request,
-    bool is_hit, int32_t num_words_per_line,
-    std::shared_ptr<CacheLine<DragonStatus>> line,
-    std::shared_ptr<MemoryController> memory_controller,
-    std::shared_ptr<StatisticsAccumulator> stats_accum)
-    -> std::shared_ptr<std::tuple<BusRequest, int32_t>> {
+void DragonProtocol::handle_bus_request(
+    const BusRequest &request, int32_t controller_id,
+    std::optional<std::tuple<BusRequest, int32_t>> &pending_bus_request,
+    bool is_hit, int32_t num_words_per_line, CacheLine<DragonStatus> *line,
+    const Context &context) {
   // Respond to request
   if (!pending_bus_request) {
 #ifdef DEBUG_FLAG
@@ -498,8 +320,8 @@ auto DragonProtocol::handle_bus_request(
               << " is not busy -> Serve request" << std::endl;
 #endif
 
-    bus->response_is_present_bits.at(controller_id) = is_hit;
-    bus->response_wait_bits.at(controller_id) = is_hit;
+    context.bus->response_is_present_bits.set(controller_id, is_hit);
+    context.bus->response_wait_bits.set(controller_id, is_hit);
 
     if (is_hit && request.type == BusRequestType::BusRd) {
 #ifdef DEBUG_FLAG
@@ -507,51 +329,83 @@ auto DragonProtocol::handle_bus_request(
                 << " is hit! Initiate cache-to-cache transfer" << std::endl;
 #endif
       // wait 2N cycles
-      return std::make_shared<std::tuple<BusRequest, int32_t>>(
-          std::make_tuple(request, 2 * num_words_per_line - 1));
+      pending_bus_request.emplace(request, 2 * num_words_per_line - 1);
+      return;
     } else if (is_hit && request.type == BusRequestType::BusUpd) {
 #ifdef DEBUG_FLAG
       std::cout << "\t\t\tCache " << controller_id << " BusUpd send only word"
                 << std::endl;
 #endif
       // wait 2 cycles
-      stats_accum->on_invalidate(controller_id);
-      return std::make_shared<std::tuple<BusRequest, int32_t>>(
-          std::make_tuple(request, 2 - 1));
+      context.stats_accum->on_invalidate(controller_id, request.address);
+      record_sharing(request, num_words_per_line, *line,
+                     *context.stats_accum);
+      pending_bus_request.emplace(request, 2 - 1);
+      return;
     } else {
 #ifdef DEBUG_FLAG
       std::cout << "\t\t\tCache " << controller_id << " is miss!" << std::endl;
 #endif
-      bus->response_completed_bits.at(controller_id) = true;
-      return nullptr;
+      context.bus->response_completed_bits.set(controller_id);
+      return;
     }
   } else {
-#ifdef DEBUG_FLAG
-    std::cout << "\t\tCache " << controller_id << " sending cache line..."
-              << std::endl;
-#endif
-
-    // There is a pending request -> serve that
+    // The transfer scheduled by the first snoop has completed
     // Invariant: the pending request is the same as the incoming request,
     // due to atomic bus
-    auto [request, cycles_left] = *pending_bus_request;
-
-    bus->response_is_present_bits.at(controller_id) = true;
-    if (cycles_left > 1) {
-      bus->response_wait_bits.at(controller_id) = true;
-      return std::make_shared<std::tuple<BusRequest, int32_t>>(
-          std::make_tuple(request, cycles_left - 1));
-    } else {
+    const auto &request = std::get<0>(*pending_bus_request);
 #ifdef DEBUG_FLAG
-      std::cout << "\t\t\tCache " << controller_id
-                << " finished sending cache line" << std::endl;
+    std::cout << "\t\t\tCache " << controller_id
+              << " finished sending cache line" << std::endl;
 #endif
-      bus->response_completed_bits.at(controller_id) = true;
-      bus->response_wait_bits.at(controller_id) = false;
+    context.bus->response_is_present_bits.set(controller_id);
+    context.bus->response_completed_bits.set(controller_id);
+    context.bus->response_wait_bits.reset(controller_id);
+
+    // Downgrade status if necessary
+    DragonProtocol::state_transition(request, line);
+    pending_bus_request.reset();
+  }
+}
+
+template <>
+void DragonProtocol::handle_functional_access(
+    InstructionType instr_type, uint32_t tag, int32_t stamp, bool is_hit,
+    CacheLine<Status> &line, const std::vector<CacheLine<Status> *> &sharers) {
+  if (is_hit && instr_type == InstructionType::READ) {
+    return;
+  } else if (is_hit && line.status == Status::M) {
+    return;
+  } else if (is_hit && line.status == Status::E) {
+    line.status = Status::M;
+    return;
+  }
 
-      // Downgrade status if necessary
-      DragonProtocol::state_transition(request, line);
-      return nullptr;
+  if (!is_hit) {
+    // BusRd: M keeps ownership as Sm, E drops to Sc
+    for (auto sharer : sharers) {
+      if (sharer->status == Status::M) {
+        sharer->status = Status::Sm;
+      } else if (sharer->status == Status::E) {
+        sharer->status = Status::Sc;
+      }
+    }
+    line.tag = tag;
+    line.last_used = stamp;
+    if (instr_type == InstructionType::READ) {
+      line.status = sharers.empty() ? Status::E : Status::Sc;
+      return;
+    } else if (sharers.empty()) {
+      line.status = Status::M;
+      return;
     }
   }
-}
\ No newline at end of file
+
+  // BusUpd: this cache becomes the owner of the updated block
+  for (auto sharer : sharers) {
+    sharer->status = Status::Sc;
+  }
+  line.tag = tag;
+  line.last_used = stamp;
+  line.status = Status::Sm;
+}
@@ -0,0 +1,135 @@
+#include "sampling.hpp"
+
+#include "cache.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <numeric>
+
+// Two-sided 95% quantiles of Student's t distribution for 1 to 30 degrees of
+// freedom; larger samples use the normal quantile
+static constexpr std::array<double, 30> T_QUANTILES_95 = {
+    12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+    2.201,  2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+    2.080,  2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042};
+static constexpr auto Z_QUANTILE_95 = 1.960;
+
+auto estimate_mean(const std::vector<double> &values) -> Estimate {
+  const auto n = values.size();
+  if (n == 0) {
+    return Estimate{};
+  }
+  const auto mean = std::accumulate(values.begin(), values.end(), 0.0) / n;
+  if (n == 1) {
+    // A single window says nothing about the spread
+    return Estimate{mean, std::numeric_limits<double>::infinity()};
+  }
+
+  auto sum_squares = 0.0;
+  for (const auto value : values) {
+    sum_squares += (value - mean) * (value - mean);
+  }
+  const auto std_dev = std::sqrt(sum_squares / (n - 1));
+  const auto quantile = n - 1 <= T_QUANTILES_95.size()
+                            ? T_QUANTILES_95.at(n - 2)
+                            : Z_QUANTILE_95;
+  return Estimate{mean, quantile * std_dev / std::sqrt(n)};
+}
+
+SamplingEstimator::SamplingEstimator(int num_cores,
+                                     const SamplingConfig &config)
+    : num_cores(num_cores), config(config), cycles_per_instruction(num_cores),
+      total_instructions(num_cores) {}
+
+void SamplingEstimator::add_window(const SampleWindow &window) {
+  auto num_instructions = uint64_t{0};
+  for (auto i = 0; i < num_cores; i++) {
+    const auto instructions = window.instructions.at(i);
+    if (instructions > 0) {
+      cycles_per_instruction.at(i).push_back(
+          window.cycles.at(i) / static_cast<double>(instructions));
+    }
+    num_instructions += instructions;
+  }
+  if (num_instructions == 0) {
+    return;
+  }
+
+  hit_rates.push_back(window.accesses > 0
+                          ? window.hits / static_cast<double>(window.accesses)
+                          : 1.0);
+  bus_traffic_per_instruction.push_back(
+      window.bus_traffic / static_cast<double>(num_instructions));
+  num_detailed_instructions += num_instructions;
+}
+
+void SamplingEstimator::register_total_instructions(
+    int processor_id, uint64_t num_instructions) {
+  total_instructions.at(processor_id) = num_instructions;
+}
+
+auto operator<<(std::ostream &os, const SamplingEstimator &p)
+    -> std::ostream & {
+  // Counts are rounded to integers, rates are printed as percentages
+  const auto print_count = [&os](const Estimate &estimate, double scale) {
+    os << std::llround(estimate.mean * scale) << " +- ";
+    if (std::isfinite(estimate.half_width)) {
+      os << std::llround(estimate.half_width * scale);
+    } else {
+      os << estimate.half_width;
+    }
+  };
+  const auto print_rate = [&os](const Estimate &estimate) {
+    os << estimate.mean * 100.0 << "% +- " << estimate.half_width * 100.0
+       << "%";
+  };
+
+  const auto num_instructions = std::accumulate(
+      p.total_instructions.begin(), p.total_instructions.end(), uint64_t{0});
+
+  os << "-------------SAMPLED ESTIMATES (95% CONFIDENCE)-------------\n";
+  if (p.num_windows() == 0) {
+    os << "No window was sampled: the traces are shorter than one sampling "
+          "interval\n";
+    os << "------------------------------------------------------------\n";
+    return os;
+  }
+  os << "Sampled Windows: " << p.num_windows() << " (" << p.config.window
+     << " of every " << p.config.interval << " accesses per core after "
+     << p.config.warmup << " unmeasured, "
+     << p.num_detailed_instructions * 100. / num_instructions
+     << "% of instructions measured)\n";
+
+  auto core_cycles = std::vector<Estimate>{};
+  for (auto i = 0; i < p.num_cores; i++) {
+    const auto cpi = estimate_mean(p.cycles_per_instruction.at(i));
+    const auto scale = static_cast<double>(p.total_instructions.at(i));
+    core_cycles.push_back(Estimate{cpi.mean * scale, cpi.half_width * scale});
+  }
+  const auto slowest = std::max_element(
+      core_cycles.begin(), core_cycles.end(),
+      [](const auto &a, const auto &b) { return a.mean < b.mean; });
+
+  os << "Overall Execution Cycle: ";
+  print_count(*slowest, 1.0);
+  os << "\n";
+  for (auto i = 0; i < p.num_cores; i++) {
+    os << "\t Core " << i << " completes at cycle: ";
+    print_count(core_cycles.at(i), 1.0);
+    os << "\n";
+  }
+
+  os << "Hit Rate: ";
+  print_rate(estimate_mean(p.hit_rates));
+  os << "\n";
+
+  os << "Bus Traffic: ";
+  print_count(estimate_mean(p.bus_traffic_per_instruction),
+              num_instructions * static_cast<double>(WORD_SIZE >> 3));
+  os << " bytes\n";
+
+  os << "------------------------------------------------------------\n";
+  return os;
+}
@@ -0,0 +1,70 @@
+#include "sharing_tracker.hpp"
+
+#include <algorithm>
+#include <numeric>
+#include <vector>
+
+auto to_string(const SharingKind &kind) -> std::string {
+  switch (kind) {
+  case SharingKind::TrueSharing:
+    return "True Sharing";
+  case SharingKind::FalseSharing:
+    return "False Sharing";
+  case SharingKind::Migratory:
+    return "Migratory";
+  default:
+    return "Unknown";
+  }
+}
+
+void SharingTracker::record(uint32_t line_address, SharingKind kind) {
+  totals[static_cast<int>(kind)] += 1;
+  const auto [index, is_new] = top_lines.add(line_address, 1);
+  if (is_new) {
+    top_line_kinds[index] = Counts{};
+  }
+  top_line_kinds[index][static_cast<int>(kind)] += 1;
+}
+
+void SharingTracker::save(CheckpointWriter &writer) const {
+  writer.write(totals);
+  top_lines.save(writer);
+  writer.write(top_line_kinds);
+}
+
+void SharingTracker::restore(CheckpointReader &reader) {
+  reader.read(totals);
+  top_lines.restore(reader);
+  reader.read(top_line_kinds);
+}
+
+auto operator<<(std::ostream &os, const SharingTracker &p) -> std::ostream & {
+  os << "Sharing Patterns (among Invalidates/Updates):\n";
+  for (auto kind = 0; kind < NUM_SHARING_KINDS; kind++) {
+    os << "\t " << to_string(static_cast<SharingKind>(kind)) << ": "
+       << p.totals.at(kind) << "\n";
+  }
+
+  // Rank by count, then by address so that the report is deterministic
+  auto indices = std::vector<int>(p.top_lines.num_monitored());
+  std::iota(indices.begin(), indices.end(), 0);
+  std::sort(indices.begin(), indices.end(), [&p](int a, int b) {
+    const auto &entry_a = p.top_lines.entry(a);
+    const auto &entry_b = p.top_lines.entry(b);
+    return entry_a.count != entry_b.count ? entry_a.count > entry_b.count
+                                          : entry_a.key < entry_b.key;
+  });
+  const auto num_top = std::min<size_t>(NUM_TOP_SHARED_LINES, indices.size());
+
+  os << "Top " << num_top
+     << " Shared Lines ([lower, upper] bounds, breakdown since tracked):\n";
+  for (auto i = 0; i < static_cast<int>(num_top); i++) {
+    const auto &entry = p.top_lines.entry(indices.at(i));
+    const auto &counts = p.top_line_kinds.at(indices.at(i));
+    os << "\t 0x" << std::hex << entry.key << std::dec << ": ["
+       << entry.count - entry.error << ", " << entry.count
+       << "] (true: " << counts.at(0) << ", false: " << counts.at(1)
+       << ", migratory: " << counts.at(2) << ")\n";
+  }
+  return os;
+}
@@ -0,0 +1,259 @@
+#include "stack_distance.hpp"
+#include "cache.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <iomanip>
+#include <numeric>
+#include <unordered_map>
+
+namespace {
+/**
+ * @brief Fenwick tree over positions, counting the positions currently
+ * holding the most recent access of some line
+ *
+ */
+class FenwickTree {
+private:
+  std::vector<int> tree;
+
+public:
+  void reset(int size) { tree.assign(size + 1, 0); }
+
+  void add(int pos, int delta) {
+    for (auto i = pos + 1; i < static_cast<int>(tree.size()); i += i & -i) {
+      tree[i] += delta;
+    }
+  }
+
+  // Sum over [0, pos)
+  auto prefix_sum(int pos) const -> int {
+    auto sum = 0;
+    for (auto i = pos; i > 0; i -= i & -i) {
+      sum += tree[i];
+    }
+    return sum;
+  }
+};
+
+constexpr auto NO_POSITION = -1;
+} // namespace
+
+StackDistanceProfiler::StackDistanceProfiler(int block_size,
+                                             bool fold_in_invalidations)
+    : num_offset_bits(std::log2(block_size)),
+      max_set_index_bits(std::log2(PROFILE_MAX_CACHE_SIZE / block_size)),
+      fold_in_invalidations(fold_in_invalidations) {}
+
+void StackDistanceProfiler::build_events(
+    const std::array<std::vector<Instruction>, NUM_CORES> &traces) {
+  auto line_ids = std::unordered_map<uint32_t, uint32_t>{};
+  // Cores that currently hold a copy of each line, as a bitmask
+  auto holders = std::vector<uint32_t>{};
+
+  auto positions = std::array<size_t, NUM_CORES>{};
+  auto local_times = std::array<int64_t, NUM_CORES>{};
+
+  while (true) {
+    // Pick the core whose next instruction happens first (ties: lowest id)
+    auto core = -1;
+    for (auto i = 0; i < NUM_CORES; i++) {
+      if (positions.at(i) < traces.at(i).size() &&
+          (core == -1 || local_times.at(i) < local_times.at(core))) {
+        core = i;
+      }
+    }
+    if (core == -1) {
+      break;
+    }
+
+    const auto &instr = traces.at(core).at(positions.at(core));
+    positions.at(core) += 1;
+    if (instr.label == InstructionType::OTHER) {
+      local_times.at(core) += instr.num_cycles.value();
+      continue;
+    }
+    local_times.at(core) += 1;
+
+    const auto line_address =
+        static_cast<uint32_t>(instr.address.value()) >> num_offset_bits;
+    auto [it, is_new] = line_ids.try_emplace(
+        line_address, static_cast<uint32_t>(line_addresses.size()));
+    if (is_new) {
+      line_addresses.push_back(line_address);
+      holders.push_back(0);
+    }
+    const auto line_id = it->second;
+
+    events.at(core).push_back(line_id << 1);
+    num_accesses.at(core) += 1;
+
+    if (fold_in_invalidations && instr.label == InstructionType::WRITE) {
+      for (auto other = 0; other < NUM_CORES; other++) {
+        if (other != core && (holders.at(line_id) >> other) & 1) {
+          events.at(other).push_back(line_id << 1 | 1);
+        }
+      }
+      holders.at(line_id) = 0;
+    }
+    holders.at(line_id) |= 1 << core;
+  }
+}
+
+void StackDistanceProfiler::profile_core(int core, int set_index_bits) {
+  const auto &core_events = events.at(core);
+  const auto set_mask = (1u << set_index_bits) - 1;
+  const auto num_sets = 1 << set_index_bits;
+
+  // Stable counting sort of the events by set index
+  auto set_offsets = std::vector<size_t>(num_sets + 1, 0);
+  for (auto event : core_events) {
+    set_offsets.at((line_addresses[event >> 1] & set_mask) + 1) += 1;
+  }
+  std::partial_sum(set_offsets.begin(), set_offsets.end(),
+                   set_offsets.begin());
+  auto by_set = std::vector<uint32_t>(core_events.size());
+  auto cursors = set_offsets;
+  for (auto event : core_events) {
+    by_set[cursors[line_addresses[event >> 1] & set_mask]++] = event;
+  }
+
+  auto &histogram = distances.at(core).at(set_index_bits);
+  auto &infinite = infinite_distances.at(core).at(set_index_bits);
+  auto last_position = std::vector<int>(line_addresses.size(), NO_POSITION);
+  auto fenwick = FenwickTree{};
+
+  for (auto set = 0; set < num_sets; set++) {
+    const auto begin = set_offsets.at(set);
+    const auto end = set_offsets.at(set + 1);
+    if (begin == end) {
+      continue;
+    }
+    fenwick.reset(end - begin);
+
+    for (auto i = begin; i < end; i++) {
+      const auto pos = static_cast<int>(i - begin);
+      const auto line_id = by_set[i] >> 1;
+      const auto is_invalidation = by_set[i] & 1;
+      auto &last = last_position[line_id];
+
+      if (is_invalidation) {
+        if (last != NO_POSITION) {
+          fenwick.add(last, -1);
+          last = NO_POSITION;
+        }
+        continue;
+      }
+
+      if (last == NO_POSITION) {
+        infinite += 1;
+      } else {
+        // Distinct lines accessed strictly between the two accesses
+        const auto distance =
+            fenwick.prefix_sum(pos) - fenwick.prefix_sum(last + 1);
+        if (distance >= static_cast<int>(histogram.size())) {
+          histogram.resize(distance + 1, 0);
+        }
+        histogram[distance] += 1;
+        fenwick.add(last, -1);
+      }
+      fenwick.add(pos, 1);
+      last = pos;
+    }
+
+    // Lines are private to their set, so only reset the ones seen here
+    for (auto i = begin; i < end; i++) {
+      last_position[by_set[i] >> 1] = NO_POSITION;
+    }
+  }
+}
+
+void StackDistanceProfiler::profile(
+    const std::array<std::vector<Instruction>, NUM_CORES> &traces) {
+  build_events(traces);
+  for (auto core = 0; core < NUM_CORES; core++) {
+    distances.at(core).assign(max_set_index_bits + 1, {});
+    infinite_distances.at(core).assign(max_set_index_bits + 1, 0);
+    for (auto bits = 0; bits <= max_set_index_bits; bits++) {
+      profile_core(core, bits);
+    }
+  }
+}
+
+auto StackDistanceProfiler::num_misses(int core, int set_index_bits,
+                                       int associativity) const -> uint64_t {
+  const auto &histogram = distances.at(core).at(set_index_bits);
+  auto misses = infinite_distances.at(core).at(set_index_bits);
+  for (auto d = associativity; d < static_cast<int>(histogram.size()); d++) {
+    misses += histogram[d];
+  }
+  return misses;
+}
+
+auto StackDistanceProfiler::miss_ratio(int core, int cache_size,
+                                       int associativity) const -> double {
+  const auto num_lines = cache_size >> num_offset_bits;
+  if (num_lines < associativity || num_accesses.at(core) == 0) {
+    return -1.0;
+  }
+  const auto num_sets = static_cast<uint32_t>(num_lines / associativity);
+  if (!std::has_single_bit(num_sets)) {
+    return -1.0;
+  }
+  const auto set_index_bits = std::countr_zero(num_sets);
+  if (set_index_bits > max_set_index_bits) {
+    return -1.0;
+  }
+  return num_misses(core, set_index_bits, associativity) /
+         static_cast<double>(num_accesses.at(core));
+}
+
+auto operator<<(std::ostream &os, const StackDistanceProfiler &p)
+    -> std::ostream & {
+  os << "-------------STACK DISTANCE PROFILE----------\n";
+  os << "Block size: " << (1 << p.num_offset_bits) << " bytes\n";
+  os << "Coherence invalidations: "
+     << (p.fold_in_invalidations ? "folded in" : "ignored") << "\n";
+  os << "Miss rate (%) by cache size (bytes) and associativity:\n";
+
+  for (auto core = 0; core < NUM_CORES; core++) {
+    os << "\t Core " << core << " (" << p.num_accesses.at(core)
+       << " accesses):\n";
+    os << "\t\t" << std::setw(10) << "Size";
+    for (auto associativity : PROFILE_ASSOCIATIVITIES) {
+      os << std::setw(9) << (std::to_string(associativity) + "-way");
+    }
+    os << std::setw(9) << "Full" << "\n";
+
+    for (auto size = PROFILE_MIN_CACHE_SIZE; size <= PROFILE_MAX_CACHE_SIZE;
+         size <<= 1) {
+      os << "\t\t" << std::setw(10) << size;
+      for (auto associativity : PROFILE_ASSOCIATIVITIES) {
+        const auto ratio = p.miss_ratio(core, size, associativity);
+        if (ratio < 0) {
+          os << std::setw(9) << "-";
+        } else {
+          os << std::setw(9) << std::fixed << std::setprecision(2)
+             << ratio * 100.0 << std::defaultfloat;
+        }
+      }
+      // Fully associative: a single set holding every line
+      const auto num_lines = size >> p.num_offset_bits;
+      const auto ratio =
+          p.num_accesses.at(core) == 0
+              ? -1.0
+              : p.num_misses(core, 0, num_lines) /
+                    static_cast<double>(p.num_accesses.at(core));
+      if (ratio < 0) {
+        os << std::setw(9) << "-";
+      } else {
+        os << std::setw(9) << std::fixed << std::setprecision(2)
+           << ratio * 100.0 << std::defaultfloat;
+      }
+      os << "\n";
+    }
+  }
+  os << "---------------------------------------------\n";
+  return os;
+}
@@ -12,24 +12,45 @@ StatisticsAccumulator::StatisticsAccumulator(int num_cores,
       num_computes_instr(num_cores), num_read_hits(num_cores),
       num_write_hits(num_cores), num_computes(num_cores),
       cycles_completion(num_cores, -1), cycles_others(num_cores, -1),
-      num_idles(num_cores), num_invalidates(num_cores),
-      cache_accesses(num_cores) {}
+      num_idles(num_cores), num_misses(num_cores), num_invalidates(num_cores),
+      cache_accesses(num_cores, StateCounters{}),
+      num_bus_traffic_per_core(num_cores), latencies(num_cores),
+      is_cache_to_cache(num_cores, false) {}
+
+auto to_string(const LatencyKind &kind) -> std::string {
+  switch (kind) {
+  case LatencyKind::MemoryMiss:
+    return "Memory Miss";
+  case LatencyKind::CacheToCacheMiss:
+    return "Cache-to-Cache Miss";
+  case LatencyKind::Upgrade:
+    return "Upgrade";
+  case LatencyKind::BusWait:
+    return "Bus Wait";
+  default:
+    return "Unknown";
+  }
+}
 
 void StatisticsAccumulator::register_num_loads(int processor_id,
-                                               int num_instr) {
+                                               int64_t num_instr) {
   num_loads_instr.at(processor_id) = num_instr;
 }
 
 void StatisticsAccumulator::register_num_stores(int processor_id,
-                                                int num_instr) {
+                                                int64_t num_instr) {
   num_stores_instr.at(processor_id) = num_instr;
 }
 
 void StatisticsAccumulator::register_num_computes(int processor_id,
-                                                  int num_instr) {
+                                                  int64_t num_instr) {
   num_computes_instr.at(processor_id) = num_instr;
 }
 
+void StatisticsAccumulator::register_block_size(int block_size) {
+  line_address_mask = ~static_cast<uint32_t>(block_size - 1);
+}
+
 void StatisticsAccumulator::on_run_end(int processor_id, int cycle_count) {
   if (cycles_completion.at(processor_id) == -1) {
     cycles_completion.at(processor_id) = cycle_count;
@@ -37,39 +58,168 @@ void StatisticsAccumulator::on_run_end(int processor_id, int cycle_count) {
 }
 
 void StatisticsAccumulator::on_compute(int processor_id) {
-  num_computes.at(processor_id) += 1;
+  num_computes[processor_id] += 1;
 }
 
 void StatisticsAccumulator::on_read_hit(int processor_id, int state_id,
                                         int cycle_count) {
-  num_read_hits.at(processor_id) += 1;
-  cache_accesses.at(processor_id).at(0)[state_id] += 1;
+  // Hot path: indices are trusted, see Protocol<Status>'s static_assert
+  num_read_hits[processor_id] += 1;
+  cache_accesses[processor_id][0][state_id] += 1;
 }
 
 void StatisticsAccumulator::on_write_hit(int processor_id, int state_id,
                                          int cycle_count) {
-  num_write_hits.at(processor_id) += 1;
-  cache_accesses.at(processor_id).at(1)[state_id] += 1;
+  num_write_hits[processor_id] += 1;
+  cache_accesses[processor_id][1][state_id] += 1;
 }
 
 void StatisticsAccumulator::on_idle(int processor_id, int cycle_count) {
-  num_idles.at(processor_id) += 1;
+  num_idles[processor_id] += 1;
+}
+
+void StatisticsAccumulator::on_miss(int processor_id, int cycle_count,
+                                    int latency) {
+  num_misses.at(processor_id) += 1;
+
+  const auto kind = is_cache_to_cache.at(processor_id)
+                        ? LatencyKind::CacheToCacheMiss
+                        : LatencyKind::MemoryMiss;
+  latencies.at(processor_id).at(static_cast<int>(kind)).record(latency);
+  is_cache_to_cache.at(processor_id) = false;
+}
+
+void StatisticsAccumulator::on_upgrade(int processor_id, int latency) {
+  latencies.at(processor_id)
+      .at(static_cast<int>(LatencyKind::Upgrade))
+      .record(latency);
+}
+
+void StatisticsAccumulator::on_cache_to_cache_transfer(int processor_id) {
+  is_cache_to_cache.at(processor_id) = true;
 }
 
-void StatisticsAccumulator::on_write_back() { num_write_backs += 1; }
+void StatisticsAccumulator::on_bus_wait(int processor_id, int cycles) {
+  latencies.at(processor_id)
+      .at(static_cast<int>(LatencyKind::BusWait))
+      .record(cycles);
+}
+
+void StatisticsAccumulator::on_write_back_stall(int cycles) {
+  write_back_stalls.record(cycles);
+}
 
-void StatisticsAccumulator::on_bus_traffic(int num_words) {
+auto StatisticsAccumulator::is_private_state(int state_id) const -> bool {
+  return std::find(private_states.begin(), private_states.end(), state_id) !=
+         private_states.end();
+}
+
+auto StatisticsAccumulator::is_public_state(int state_id) const -> bool {
+  return std::find(public_states.begin(), public_states.end(), state_id) !=
+         public_states.end();
+}
+
+void StatisticsAccumulator::on_write_back(uint32_t address) {
+  num_write_backs += 1;
+  hot_write_back_lines.add(address & line_address_mask);
+}
+
+void StatisticsAccumulator::on_bus_traffic(int processor_id, uint32_t address,
+                                           int num_words) {
   num_bus_traffic += num_words;
+  num_bus_traffic_per_core.at(processor_id) += num_words;
+  hot_bus_lines.add(address & line_address_mask);
 }
 
-void StatisticsAccumulator::on_invalidate(int processor_id) {
+void StatisticsAccumulator::on_invalidate(int processor_id, uint32_t address) {
   num_invalidates.at(processor_id) += 1;
+  hot_invalidate_lines.add(address & line_address_mask);
+}
+
+void StatisticsAccumulator::on_sharing(uint32_t line_address,
+                                       SharingKind kind) {
+  sharing_tracker.record(line_address, kind);
+}
+
+auto StatisticsAccumulator::get_core_counters(int processor_id) const
+    -> CoreCounters {
+  return CoreCounters{num_read_hits.at(processor_id),
+                      num_write_hits.at(processor_id),
+                      num_misses.at(processor_id),
+                      num_idles.at(processor_id),
+                      num_bus_traffic_per_core.at(processor_id),
+                      num_invalidates.at(processor_id)};
+}
+
+auto StatisticsAccumulator::get_summary() const -> RunSummary {
+  return RunSummary{
+      *std::max_element(cycles_completion.begin(), cycles_completion.end()),
+      num_bus_traffic * (WORD_SIZE >> 3),
+      num_write_backs};
 }
 
 // void StatisticsAccumulator::on_cache_access(int processor_id, int state_id) {
 //   cache_accesses.at(processor_id)[state_id] += 1;
 // }
 
+void StatisticsAccumulator::save(CheckpointWriter &writer) const {
+  writer.write(num_loads_instr);
+  writer.write(num_stores_instr);
+  writer.write(num_computes_instr);
+  writer.write(num_read_hits);
+  writer.write(num_write_hits);
+  writer.write(num_computes);
+  writer.write(cycles_completion);
+  writer.write(cycles_others);
+  writer.write(num_idles);
+  writer.write(num_misses);
+  writer.write(num_invalidates);
+  writer.write(cache_accesses);
+  writer.write(num_write_backs);
+  writer.write(num_bus_traffic);
+  writer.write(num_bus_traffic_per_core);
+  for (const auto &core_latencies : latencies) {
+    for (const auto &histogram : core_latencies) {
+      histogram.save(writer);
+    }
+  }
+  writer.write(is_cache_to_cache);
+  write_back_stalls.save(writer);
+  sharing_tracker.save(writer);
+  hot_bus_lines.save(writer);
+  hot_write_back_lines.save(writer);
+  hot_invalidate_lines.save(writer);
+}
+
+void StatisticsAccumulator::restore(CheckpointReader &reader) {
+  reader.read(num_loads_instr);
+  reader.read(num_stores_instr);
+  reader.read(num_computes_instr);
+  reader.read(num_read_hits);
+  reader.read(num_write_hits);
+  reader.read(num_computes);
+  reader.read(cycles_completion);
+  reader.read(cycles_others);
+  reader.read(num_idles);
+  reader.read(num_misses);
+  reader.read(num_invalidates);
+  reader.read(cache_accesses);
+  reader.read(num_write_backs);
+  reader.read(num_bus_traffic);
+  reader.read(num_bus_traffic_per_core);
+  for (auto &core_latencies : latencies) {
+    for (auto &histogram : core_latencies) {
+      histogram.restore(reader);
+    }
+  }
+  reader.read(is_cache_to_cache);
+  write_back_stalls.restore(reader);
+  sharing_tracker.restore(reader);
+  hot_bus_lines.restore(reader);
+  hot_write_back_lines.restore(reader);
+  hot_invalidate_lines.restore(reader);
+}
+
 auto operator<<(std::ostream &os, const StatisticsAccumulator &p)
     -> std::ostream & {
   const auto max_cycle =
@@ -141,38 +291,22 @@ auto operator<<(std::ostream &os, const StatisticsAccumulator &p)
   for (auto i = 0; i < p.cache_accesses.size(); i++) {
     const auto &[reads, writes] = p.cache_accesses.at(i);
 
-    auto public_accesses = 0;
-    auto public_read = 0;
-    auto public_write = 0;
+    auto public_accesses = int64_t{0};
+    auto public_read = int64_t{0};
+    auto public_write = int64_t{0};
     for (auto state_id : p.public_states) {
-      auto read_accesses = reads.find(state_id);
-      if (read_accesses != reads.end()) {
-        public_accesses += read_accesses->second;
-        public_read += read_accesses->second;
-      }
-
-      auto write_accesses = writes.find(state_id);
-      if (write_accesses != writes.end()) {
-        public_accesses += write_accesses->second;
-        public_write += write_accesses->second;
-      }
+      public_accesses += reads.at(state_id) + writes.at(state_id);
+      public_read += reads.at(state_id);
+      public_write += writes.at(state_id);
     }
 
-    auto private_accesses = 0;
-    auto private_read = 0;
-    auto private_write = 0;
+    auto private_accesses = int64_t{0};
+    auto private_read = int64_t{0};
+    auto private_write = int64_t{0};
     for (auto state_id : p.private_states) {
-      auto read_accesses = reads.find(state_id);
-      if (read_accesses != reads.end()) {
-        private_accesses += read_accesses->second;
-        private_read += read_accesses->second;
-      }
-
-      auto write_accesses = writes.find(state_id);
-      if (write_accesses != writes.end()) {
-        private_accesses += write_accesses->second;
-        private_write += write_accesses->second;
-      }
+      private_accesses += reads.at(state_id) + writes.at(state_id);
+      private_read += reads.at(state_id);
+      private_write += writes.at(state_id);
     }
 
     auto private_read_pct =
@@ -207,13 +341,21 @@ auto operator<<(std::ostream &os, const StatisticsAccumulator &p)
 
     os << "\tCore " << i << ":\n";
     os << "\t\tReads: \n";
-    for (auto &[state_id, count] : reads) {
+    for (auto state_id = 0; state_id < MAX_NUM_STATES; state_id++) {
+      const auto count = reads.at(state_id);
+      if (count == 0) {
+        continue;
+      }
       os << "\t\t\tState " << state_id << ": " << count << " ("
          << count * 100. / p.num_read_hits.at(i) << "%)\n";
     }
 
     os << "\t\tWrites: \n";
-    for (auto &[state_id, count] : writes) {
+    for (auto state_id = 0; state_id < MAX_NUM_STATES; state_id++) {
+      const auto count = writes.at(state_id);
+      if (count == 0) {
+        continue;
+      }
       os << "\t\t\tState " << state_id << ": " << count << " ("
          << count * 100. / p.num_write_hits.at(i) << "%)\n";
     }
@@ -227,6 +369,22 @@ auto operator<<(std::ostream &os, const StatisticsAccumulator &p)
   for (auto i = 0; i < p.num_invalidates.size(); i++) {
     os << "\t Core " << i << ": " << p.num_invalidates.at(i) << "\n";
   }
+  os << p.sharing_tracker;
+
+  os << "Hot Lines (events per line, [lower, upper] bounds):\n";
+  p.hot_bus_lines.print(os, "Bus Transactions");
+  p.hot_write_back_lines.print(os, "Write Backs");
+  p.hot_invalidate_lines.print(os, "Invalidates/Updates");
+
+  os << "Latency Distributions (cycles):\n";
+  for (size_t i = 0; i < p.latencies.size(); i++) {
+    os << "\t Core " << i << ":\n";
+    for (auto kind = 0; kind < NUM_LATENCY_KINDS; kind++) {
+      os << "\t\t " << to_string(static_cast<LatencyKind>(kind)) << ": "
+         << p.latencies.at(i).at(kind).summary() << "\n";
+    }
+  }
+  os << "\t Write-Back Stall: " << p.write_back_stalls.summary() << "\n";
 
   os << "---------------------------------------------\n";
   return os;
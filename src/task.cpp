@@ -0,0 +1,60 @@
+#include "task.hpp"
+
+#include <new>
+#include <vector>
+
+namespace {
+/**
+ * @brief Frames of finished tasks, kept by size for the next task of the
+ * same handler, so that a bus transaction does not allocate. Each thread
+ * has its own pool; a frame may be freed by another thread than the one
+ * that allocated it.
+ *
+ */
+class FramePool {
+private:
+  std::vector<std::pair<size_t, std::vector<void *>>> free_frames;
+
+public:
+  FramePool() = default;
+  FramePool(const FramePool &) = delete;
+  ~FramePool() {
+    for (auto &[size, frames] : free_frames) {
+      for (auto frame : frames) {
+        ::operator delete(frame, size);
+      }
+    }
+  }
+
+  auto allocate(size_t size) -> void * {
+    for (auto &[frame_size, frames] : free_frames) {
+      if (frame_size == size && !frames.empty()) {
+        auto frame = frames.back();
+        frames.pop_back();
+        return frame;
+      }
+    }
+    return ::operator new(size);
+  }
+
+  void free(void *frame, size_t size) {
+    for (auto &[frame_size, frames] : free_frames) {
+      if (frame_size == size) {
+        frames.push_back(frame);
+        return;
+      }
+    }
+    free_frames.emplace_back(size, std::vector<void *>{frame});
+  }
+};
+
+thread_local FramePool frame_pool;
+} // namespace
+
+auto Task::promise_type::operator new(size_t size) -> void * {
+  return frame_pool.allocate(size);
+}
+
+void Task::promise_type::operator delete(void *frame, size_t size) {
+  frame_pool.free(frame, size);
+}
@@ -1,108 +1,206 @@
 #include "trace.hpp"
+#include "trace_source.hpp"
 
 #include <array>
+#include <charconv>
 #include <cstdlib>
+#include <cstring>
 #include <filesystem>
 #include <fstream>
 #include <iostream>
 #include <optional>
 #include <sstream>
+#include <string>
+#include <system_error>
+#include <unistd.h>
 #include <vector>
 
-static constexpr auto read_instruction_type(int x)
-    -> std::optional<InstructionType> {
-  if (x == 0) {
-    return InstructionType::READ;
-  } else if (x == 1) {
-    return InstructionType::WRITE;
-  } else if (x == 2) {
-    return InstructionType::OTHER;
-  } else {
-    return std::nullopt;
-  }
-}
-
 auto is_null_instr(const Instruction &instr) -> bool {
   return instr.label == InstructionType::OTHER && instr.num_cycles == 0 &&
          instr.address == std::nullopt;
 }
 
-auto read_trace(const std::filesystem::path &path) -> std::vector<Instruction> {
-  auto filestream = std::ifstream{path.c_str(), std::ios::binary};
-  auto instructions = std::vector<Instruction>{};
+static constexpr auto TRACE_WRITER_BUFFER_SIZE = 1 << 20;
+
+TraceWriter::TraceWriter(const std::filesystem::path &path, bool is_binary)
+    : file(path, std::ios::binary), is_binary(is_binary) {
+  if (!file) {
+    std::cerr << "Cannot open " << path << " for writing!" << std::endl;
+    std::exit(1);
+  }
+  buffer.reserve(TRACE_WRITER_BUFFER_SIZE + 64);
+  if (is_binary) {
+    buffer.insert(buffer.end(), std::begin(BINARY_TRACE_MAGIC),
+                  std::end(BINARY_TRACE_MAGIC));
+  }
+}
 
-  std::string line;
-  while (std::getline(filestream, line)) {
-    std::istringstream iss(line);
+TraceWriter::~TraceWriter() { flush(); }
 
-    int label;
-    std::string value_str;
-    if (!(iss >> label >> value_str)) {
-      break;
-    }
+void TraceWriter::flush() {
+  file.write(buffer.data(), buffer.size());
+  buffer.clear();
+}
 
-    auto type = read_instruction_type(label);
-    if (!type.has_value()) {
-      std::cerr << "Instruction type: " << label << " is invalid!";
-      std::exit(1);
-    }
-    auto instruction_type = type.value();
-    Value value = std::stoul(value_str, nullptr, 16);
-
-    switch (instruction_type) {
-    case InstructionType::OTHER: {
-      instructions.push_back(
-          Instruction{instruction_type, value, std::nullopt});
-    } break;
-    default: {
-      instructions.push_back(
-          Instruction{instruction_type, std::nullopt, value});
-    } break;
-    }
+void TraceWriter::write(const Instruction &instr) {
+  const auto value = static_cast<uint32_t>(
+      instr.label == InstructionType::OTHER ? instr.num_cycles.value()
+                                            : instr.address.value());
+  if (is_binary) {
+    const auto record =
+        BinaryTraceRecord{static_cast<uint32_t>(instr.label), value};
+    const auto bytes = reinterpret_cast<const char *>(&record);
+    buffer.insert(buffer.end(), bytes, bytes + sizeof(record));
+  } else {
+    // "<label> 0x<value in hex>\n"
+    char line[16];
+    line[0] = static_cast<char>('0' + instr.label);
+    line[1] = ' ';
+    line[2] = '0';
+    line[3] = 'x';
+    auto end = std::to_chars(line + 4, line + sizeof(line) - 1, value, 16).ptr;
+    *end++ = '\n';
+    buffer.insert(buffer.end(), line, end);
   }
 
-  return instructions;
+  if (buffer.size() >= TRACE_WRITER_BUFFER_SIZE) {
+    flush();
+  }
 }
 
-auto parse_traces(std::string path_str)
-    -> std::array<std::vector<Instruction>, NUM_CORES> {
+void decode_trace(std::vector<Instruction> &instructions,
+                  const AddressGeometry &geometry) {
+  for (auto &instr : instructions) {
+    if (instr.label != InstructionType::OTHER) {
+      instr.parsed_address =
+          parse_address(static_cast<uint32_t>(instr.address.value()),
+                        geometry.num_offset_bits, geometry.num_set_index_bits);
+    }
+  }
+}
 
-  auto dirpath = std::filesystem::path{path_str};
+/**
+ * @brief Header of a trace decoded from `source` for `geometry`, with
+ * `num_records` records
+ *
+ */
+static auto decoded_trace_header(const AddressGeometry &geometry,
+                                 uint64_t num_records,
+                                 const std::filesystem::path &source)
+    -> DecodedTraceHeader {
+  auto header = DecodedTraceHeader{};
+  std::memcpy(header.magic, DECODED_TRACE_MAGIC, sizeof(DECODED_TRACE_MAGIC));
+  header.geometry = geometry;
+  header.num_records = num_records;
+  header.source_size = std::filesystem::file_size(source);
+  header.source_mtime =
+      std::filesystem::last_write_time(source).time_since_epoch().count();
+  return header;
+}
 
-  if (!std::filesystem::exists(dirpath)) {
-    std::cerr << "Given path: " << dirpath << " does not exist!" << std::endl;
-    std::exit(1);
+void write_decoded_trace(const std::filesystem::path &path,
+                         const std::vector<Instruction> &instructions,
+                         const AddressGeometry &geometry,
+                         const std::filesystem::path &source) {
+  auto records = std::vector<DecodedTraceRecord>{};
+  records.reserve(instructions.size());
+  for (const auto &instr : instructions) {
+    if (instr.label == InstructionType::OTHER) {
+      records.push_back(DecodedTraceRecord{
+          static_cast<uint32_t>(instr.label),
+          static_cast<uint32_t>(instr.num_cycles.value()), 0, 0});
+    } else {
+      const auto &parsed = instr.parsed_address.value();
+      records.push_back(DecodedTraceRecord{static_cast<uint32_t>(instr.label),
+                                           parsed.address, parsed.tag,
+                                           parsed.set_index});
+    }
   }
+  const auto header = decoded_trace_header(geometry, records.size(), source);
+
+  // Unique per process, as several runs may share the trace directory
+  auto tmp_path = path;
+  tmp_path += ".tmp." + std::to_string(getpid());
+  {
+    auto file = std::ofstream{tmp_path, std::ios::binary};
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char *>(records.data()),
+               records.size() * sizeof(DecodedTraceRecord));
+    file.close();
+    if (file) {
+      auto error = std::error_code{};
+      std::filesystem::rename(tmp_path, path, error);
+      if (!error) {
+        return;
+      }
+    }
+  }
+  std::cerr << "Warning: cannot write the decoded trace " << path
+            << ", it will be decoded again next time" << std::endl;
+  auto error = std::error_code{};
+  std::filesystem::remove(tmp_path, error);
+}
 
-  if (!std::filesystem::is_directory(dirpath)) {
-    std::cerr << "Given path: " << dirpath << " is not a directory!"
-              << std::endl;
-    std::exit(1);
+auto read_decoded_trace(const std::filesystem::path &path,
+                        const AddressGeometry &geometry,
+                        const std::filesystem::path &source)
+    -> std::optional<std::vector<Instruction>> {
+  auto file = std::ifstream{path, std::ios::binary};
+  auto header = DecodedTraceHeader{};
+  file.read(reinterpret_cast<char *>(&header), sizeof(header));
+  if (!file) {
+    return std::nullopt;
+  }
+  const auto expected = decoded_trace_header(geometry, header.num_records,
+                                             source);
+  if (std::memcmp(header.magic, expected.magic, sizeof(header.magic)) != 0 ||
+      header.geometry != expected.geometry ||
+      header.source_size != expected.source_size ||
+      header.source_mtime != expected.source_mtime ||
+      std::filesystem::file_size(path) !=
+          sizeof(header) + header.num_records * sizeof(DecodedTraceRecord)) {
+    return std::nullopt;
   }
 
-  const auto benchmark_name = dirpath.filename();
-  std::cout << "Running benchmark: " << benchmark_name << std::endl;
-
-  std::array<std::vector<Instruction>, NUM_CORES> instructions;
-  for (int i = 0; i < NUM_CORES; i++) {
-    std::stringstream ss;
-    ss << benchmark_name.c_str() << "_" << i << ".data";
-    auto filename = ss.str();
-    auto filepath = dirpath;
-    filepath.append(filename);
-
-    if (!std::filesystem::exists(filepath)) {
-      std::cerr << "Test file: " << filepath.c_str() << " does not exist!"
-                << std::endl;
-      std::exit(1);
+  // The offset is all that is left to split off
+  const auto offset_mask = (uint32_t{1} << geometry.num_offset_bits) - 1;
+  auto instructions = std::vector<Instruction>{};
+  DecodedTraceRecord records[1024];
+  while (file) {
+    file.read(reinterpret_cast<char *>(records), sizeof(records));
+    const auto num_read = file.gcount() / sizeof(DecodedTraceRecord);
+    for (size_t i = 0; i < num_read; i++) {
+      const auto &record = records[i];
+      switch (record.label) {
+      case InstructionType::READ:
+      case InstructionType::WRITE:
+        instructions.emplace_back(
+            static_cast<InstructionType>(record.label), std::nullopt,
+            static_cast<int>(record.value),
+            ParsedAddress{record.tag, record.set_index,
+                          record.value & offset_mask, record.value});
+        break;
+      case InstructionType::OTHER:
+        instructions.emplace_back(InstructionType::OTHER,
+                                  static_cast<int>(record.value),
+                                  std::nullopt);
+        break;
+      default:
+        return std::nullopt;
+      }
     }
-    instructions.at(i) = read_trace(filepath);
   }
-
-  std::cout << "Trace parsed successfully!" << std::endl;
+  if (instructions.size() != header.num_records) {
+    return std::nullopt;
+  }
   return instructions;
 }
 
+auto read_trace(const std::filesystem::path &path) -> std::vector<Instruction> {
+  auto source = FileTraceSource{path};
+  return drain(source);
+}
+
 auto to_string(const InstructionType &instr_type) -> std::string {
   switch (instr_type) {
   case InstructionType::READ:
@@ -0,0 +1,324 @@
+#include "trace_source.hpp"
+
+#include <cctype>
+#include <charconv>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+static constexpr auto TRACE_SOURCE_CHUNK_SIZE = size_t{1} << 16;
+
+static auto make_instruction(int label, Value value)
+    -> std::optional<Instruction> {
+  switch (label) {
+  case InstructionType::READ:
+  case InstructionType::WRITE:
+    return Instruction{static_cast<InstructionType>(label), std::nullopt,
+                       static_cast<int>(value)};
+  case InstructionType::OTHER:
+    return Instruction{InstructionType::OTHER, static_cast<int>(value),
+                       std::nullopt};
+  default:
+    return std::nullopt;
+  }
+}
+
+static auto skip_whitespace(const char *first, const char *last)
+    -> const char * {
+  while (first != last && std::isspace(static_cast<unsigned char>(*first))) {
+    first++;
+  }
+  return first;
+}
+
+/**
+ * @brief Parse a "<label> <hex value>" line. Returns false on a line that is
+ * not an instruction, which ends the trace.
+ *
+ */
+static auto parse_text_line(const std::string &line,
+                            std::vector<Instruction> &instructions) -> bool {
+  const auto last = line.data() + line.size();
+  auto first = skip_whitespace(line.data(), last);
+
+  auto label = 0;
+  auto [label_end, label_ec] = std::from_chars(first, last, label);
+  if (label_ec != std::errc{}) {
+    return false;
+  }
+  first = skip_whitespace(label_end, last);
+  if (first == last) {
+    return false;
+  }
+  if (last - first > 1 && first[0] == '0' &&
+      (first[1] == 'x' || first[1] == 'X')) {
+    first += 2;
+  }
+
+  auto value = Value{0};
+  auto [value_end, value_ec] = std::from_chars(first, last, value, 16);
+  if (value_ec != std::errc{}) {
+    std::cerr << "Invalid trace line: " << line << std::endl;
+    std::exit(1);
+  }
+
+  auto instr = make_instruction(label, value);
+  if (!instr.has_value()) {
+    std::cerr << "Instruction type: " << label << " is invalid!";
+    std::exit(1);
+  }
+  instructions.push_back(instr.value());
+  return true;
+}
+
+FileTraceSource::FileTraceSource(const std::filesystem::path &path)
+    : file(path, std::ios::binary) {
+  char magic[sizeof(BINARY_TRACE_MAGIC)] = {};
+  file.read(magic, sizeof(magic));
+  is_binary = file.gcount() == sizeof(magic) &&
+              std::memcmp(magic, BINARY_TRACE_MAGIC, sizeof(magic)) == 0;
+  if (!is_binary) {
+    file.clear();
+    file.seekg(0);
+  }
+  buffer.reserve(TRACE_SOURCE_CHUNK_SIZE);
+  refill();
+}
+
+void FileTraceSource::refill() {
+  buffer.clear();
+  next_idx = 0;
+
+  if (is_binary) {
+    BinaryTraceRecord records[1024];
+    while (file && buffer.size() < TRACE_SOURCE_CHUNK_SIZE) {
+      file.read(reinterpret_cast<char *>(records), sizeof(records));
+      const auto num_read = file.gcount() / sizeof(BinaryTraceRecord);
+      for (size_t i = 0; i < num_read; i++) {
+        auto instr = make_instruction(static_cast<int>(records[i].label),
+                                      records[i].value);
+        if (!instr.has_value()) {
+          std::cerr << "Instruction type: " << records[i].label
+                    << " is invalid!";
+          std::exit(1);
+        }
+        buffer.push_back(instr.value());
+      }
+    }
+    return;
+  }
+
+  std::string line;
+  while (buffer.size() < TRACE_SOURCE_CHUNK_SIZE && std::getline(file, line)) {
+    if (!parse_text_line(line, buffer)) {
+      // Anything after a malformed line is ignored
+      file.setstate(std::ios::eofbit);
+      break;
+    }
+  }
+}
+
+auto FileTraceSource::next() -> Instruction {
+  auto instr = buffer.at(next_idx++);
+  if (next_idx == buffer.size()) {
+    refill();
+  }
+  return instr;
+}
+
+auto parse_synthetic_input(const std::string &input)
+    -> std::optional<WorkloadPattern> {
+  if (input.rfind(SYNTHETIC_INPUT_PREFIX, 0) != 0) {
+    return std::nullopt;
+  }
+  const auto name = input.substr(SYNTHETIC_INPUT_PREFIX.size());
+  const auto pattern = parse_workload_pattern(name);
+  if (!pattern.has_value()) {
+    std::stringstream ss;
+    ss << "Invalid synthetic pattern: " << name << std::endl;
+    throw std::runtime_error{ss.str()};
+  }
+  return pattern;
+}
+
+/**
+ * @brief Check that a benchmark directory exists, and announce it
+ *
+ */
+static auto open_benchmark_dir(const std::string &path_str)
+    -> std::filesystem::path {
+  auto dirpath = std::filesystem::path{path_str};
+
+  if (!std::filesystem::exists(dirpath)) {
+    std::cerr << "Given path: " << dirpath << " does not exist!" << std::endl;
+    std::exit(1);
+  }
+
+  if (!std::filesystem::is_directory(dirpath)) {
+    std::cerr << "Given path: " << dirpath << " is not a directory!"
+              << std::endl;
+    std::exit(1);
+  }
+
+  std::cout << "Running benchmark: " << dirpath.filename() << std::endl;
+  return dirpath;
+}
+
+static auto trace_file_name(const std::filesystem::path &dirpath, int core)
+    -> std::filesystem::path {
+  std::stringstream ss;
+  ss << dirpath.filename().c_str() << "_" << core << ".data";
+  auto filepath = dirpath;
+  filepath.append(ss.str());
+  return filepath;
+}
+
+/**
+ * @brief Path of core `core`'s trace file <name>_<core>.data, or nullopt if
+ * the benchmark has none. Exits if core 0 has none.
+ *
+ */
+static auto trace_file_path(const std::filesystem::path &dirpath, int core)
+    -> std::optional<std::filesystem::path> {
+  const auto filepath = trace_file_name(dirpath, core);
+  if (!std::filesystem::exists(filepath)) {
+    std::cerr << "Test file: " << filepath.c_str() << " does not exist!"
+              << std::endl;
+    if (core == 0) {
+      std::exit(1);
+    }
+    return std::nullopt;
+  }
+  return filepath;
+}
+
+auto open_trace_files(const std::string &path_str) -> TraceSources {
+  const auto dirpath = open_benchmark_dir(path_str);
+
+  auto sources = TraceSources{};
+  for (int i = 0; i < NUM_CORES; i++) {
+    const auto filepath = trace_file_path(dirpath, i);
+    if (!filepath) {
+      // Benchmarks written for fewer cores leave the remaining cores idle
+      sources.at(i) =
+          std::make_unique<VectorTraceSource>(std::vector<Instruction>{});
+      continue;
+    }
+    sources.at(i) = std::make_unique<FileTraceSource>(filepath.value());
+  }
+
+  std::cout << "Trace parsed successfully!" << std::endl;
+  return sources;
+}
+
+auto trace_file_identity(const std::string &path_str) -> TraceIdentity {
+  const auto dirpath = std::filesystem::path{path_str};
+  auto identity = TraceIdentity{};
+  for (int i = 0; i < NUM_CORES; i++) {
+    const auto filepath = trace_file_name(dirpath, i);
+    if (std::filesystem::exists(filepath)) {
+      identity.lengths.at(i) = std::filesystem::file_size(filepath);
+      identity.mtimes.at(i) = std::filesystem::last_write_time(filepath)
+                                  .time_since_epoch()
+                                  .count();
+    }
+  }
+  return identity;
+}
+
+auto synthetic_trace_identity(const WorkloadConfig &config, uint64_t length)
+    -> TraceIdentity {
+  auto identity = TraceIdentity{};
+  identity.pattern = static_cast<int64_t>(config.pattern);
+  identity.seed = config.seed;
+  identity.lengths.fill(length);
+  return identity;
+}
+
+auto load_decoded_trace_files(const std::string &path_str,
+                              const AddressGeometry &geometry)
+    -> SharedTraces {
+  const auto dirpath = open_benchmark_dir(path_str);
+
+  auto traces = SharedTraces{};
+  for (int i = 0; i < NUM_CORES; i++) {
+    const auto filepath = trace_file_path(dirpath, i);
+    auto instructions = std::vector<Instruction>{};
+    if (filepath) {
+      auto decoded_path = filepath.value();
+      decoded_path += DECODED_TRACE_SUFFIX;
+      auto decoded = std::optional<std::vector<Instruction>>{};
+      if (std::filesystem::exists(decoded_path)) {
+        decoded = read_decoded_trace(decoded_path, geometry, filepath.value());
+      }
+
+      if (decoded) {
+        instructions = std::move(decoded.value());
+      } else {
+        auto source = FileTraceSource{filepath.value()};
+        instructions = drain(source);
+        decode_trace(instructions, geometry);
+        if (source.has_binary_format()) {
+          write_decoded_trace(decoded_path, instructions, geometry,
+                              filepath.value());
+        }
+      }
+    }
+    traces.at(i) = std::make_shared<const std::vector<Instruction>>(
+        std::move(instructions));
+  }
+
+  std::cout << "Trace parsed successfully!" << std::endl;
+  return traces;
+}
+
+auto make_synthetic_sources(const WorkloadConfig &config, uint64_t length)
+    -> TraceSources {
+  auto sources = TraceSources{};
+  for (int i = 0; i < NUM_CORES; i++) {
+    sources.at(i) = std::make_unique<SyntheticTraceSource>(config, i, length);
+  }
+  return sources;
+}
+
+auto make_vector_sources(
+    const std::array<std::vector<Instruction>, NUM_CORES> &traces)
+    -> TraceSources {
+  auto sources = TraceSources{};
+  for (int i = 0; i < NUM_CORES; i++) {
+    sources.at(i) = std::make_unique<VectorTraceSource>(traces.at(i));
+  }
+  return sources;
+}
+
+auto load_traces(TraceSources &sources,
+                 const std::optional<AddressGeometry> &geometry)
+    -> SharedTraces {
+  auto traces = SharedTraces{};
+  for (int i = 0; i < NUM_CORES; i++) {
+    auto instructions = drain(*sources.at(i));
+    if (geometry) {
+      decode_trace(instructions, geometry.value());
+    }
+    traces.at(i) = std::make_shared<const std::vector<Instruction>>(
+        std::move(instructions));
+  }
+  return traces;
+}
+
+auto make_shared_sources(const SharedTraces &traces) -> TraceSources {
+  auto sources = TraceSources{};
+  for (int i = 0; i < NUM_CORES; i++) {
+    sources.at(i) = std::make_unique<VectorTraceSource>(traces.at(i));
+  }
+  return sources;
+}
+
+auto drain(TraceSource &source) -> std::vector<Instruction> {
+  auto instructions = std::vector<Instruction>{};
+  while (!source.is_empty()) {
+    instructions.push_back(source.next());
+  }
+  return instructions;
+}
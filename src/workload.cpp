@@ -0,0 +1,204 @@
+#include "workload.hpp"
+#include "cache.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+constexpr auto SHARED_BASE = uint32_t{0x10000000};
+constexpr auto PRIVATE_BASE = uint32_t{0x40000000};
+constexpr auto PRIVATE_REGION_SIZE = uint32_t{0x00400000}; // Per core
+static_assert(uint64_t{PRIVATE_BASE} +
+                  uint64_t{MAX_WORKLOAD_CORES} * PRIVATE_REGION_SIZE ==
+              uint64_t{1} << 32);
+
+// log1p(x) / x and expm1(x) / x, accurate near 0
+auto helper1(double x) -> double {
+  return std::abs(x) > 1e-8 ? std::log1p(x) / x
+                            : 1.0 - x * (0.5 - x * (1.0 / 3.0 - 0.25 * x));
+}
+
+auto helper2(double x) -> double {
+  return std::abs(x) > 1e-8
+             ? std::expm1(x) / x
+             : 1.0 + x * 0.5 * (1.0 + x * (1.0 / 3.0) * (1.0 + 0.25 * x));
+}
+
+auto rotl(uint64_t x, int k) -> uint64_t { return (x << k) | (x >> (64 - k)); }
+} // namespace
+
+auto to_string(const WorkloadPattern &pattern) -> std::string {
+  return WORKLOAD_PATTERNS.at(static_cast<int>(pattern));
+}
+
+auto parse_workload_pattern(const std::string &name)
+    -> std::optional<WorkloadPattern> {
+  const auto it =
+      std::find(WORKLOAD_PATTERNS.begin(), WORKLOAD_PATTERNS.end(), name);
+  if (it == WORKLOAD_PATTERNS.end()) {
+    return std::nullopt;
+  }
+  return static_cast<WorkloadPattern>(it - WORKLOAD_PATTERNS.begin());
+}
+
+Xoshiro256::Xoshiro256(uint64_t seed) {
+  for (auto &word : s) {
+    auto z = (seed += 0x9e3779b97f4a7c15);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+    word = z ^ (z >> 31);
+  }
+}
+
+auto Xoshiro256::next() -> uint64_t {
+  const auto result = rotl(s[1] * 5, 7) * 9;
+  const auto t = s[1] << 17;
+  s[2] ^= s[0];
+  s[3] ^= s[1];
+  s[1] ^= s[2];
+  s[0] ^= s[3];
+  s[2] ^= t;
+  s[3] = rotl(s[3], 45);
+  return result;
+}
+
+auto Xoshiro256::below(uint32_t bound) -> uint32_t {
+  // Lemire's multiply-shift; the bias is negligible for our bounds
+  return static_cast<uint32_t>(((next() >> 32) * bound) >> 32);
+}
+
+auto Xoshiro256::uniform() -> double {
+  return (next() >> 11) * 0x1.0p-53;
+}
+
+ZipfSampler::ZipfSampler(int n, double exponent)
+    : n(std::max(n, 1)), exponent(exponent) {
+  h_integral_x1 = h_integral(1.5) - 1.0;
+  h_integral_n = h_integral(this->n + 0.5);
+  s = 2.0 - h_integral_inverse(h_integral(2.5) - h(2.0));
+}
+
+auto ZipfSampler::h(double x) const -> double {
+  return std::exp(-exponent * std::log(x));
+}
+
+auto ZipfSampler::h_integral(double x) const -> double {
+  const auto log_x = std::log(x);
+  return helper2((1.0 - exponent) * log_x) * log_x;
+}
+
+auto ZipfSampler::h_integral_inverse(double x) const -> double {
+  const auto t = std::max(x * (1.0 - exponent), -1.0);
+  return std::exp(helper1(t) * x);
+}
+
+auto ZipfSampler::sample(Xoshiro256 &rng) const -> int {
+  while (true) {
+    const auto u =
+        h_integral_n + rng.uniform() * (h_integral_x1 - h_integral_n);
+    const auto x = h_integral_inverse(u);
+    const auto k = std::clamp(static_cast<int>(x + 0.5), 1, n);
+    if (k - x <= s || u >= h_integral(k + 0.5) - h(k)) {
+      return k;
+    }
+  }
+}
+
+WorkloadGenerator::WorkloadGenerator(const WorkloadConfig &config, int core)
+    : config(config), core(core),
+      rng(config.seed ^ (0x9e3779b97f4a7c15 * (core + 1))),
+      zipf(config.footprint, config.zipf_skew) {}
+
+auto WorkloadGenerator::shared_address(uint32_t line, uint32_t word) const
+    -> uint32_t {
+  return SHARED_BASE + line * config.block_size + word * (WORD_SIZE >> 3);
+}
+
+auto WorkloadGenerator::private_address(uint32_t line, uint32_t word) const
+    -> uint32_t {
+  const auto offset =
+      (line * config.block_size + word * (WORD_SIZE >> 3)) %
+      PRIVATE_REGION_SIZE;
+  return PRIVATE_BASE + core * PRIVATE_REGION_SIZE + offset;
+}
+
+void WorkloadGenerator::push(InstructionType label, uint32_t address) {
+  pending[num_pending++] = Access{label, address};
+}
+
+void WorkloadGenerator::generate_operation() {
+  const auto num_words = static_cast<uint32_t>(
+      std::max(config.block_size / (WORD_SIZE >> 3), 1));
+  const auto footprint = static_cast<uint32_t>(config.footprint);
+  const auto is_write = [this]() {
+    return static_cast<int>(rng.below(100)) < config.write_percent;
+  };
+
+  switch (config.pattern) {
+  case WorkloadPattern::ProducerConsumer: {
+    // Every core walks the same buffer word by word
+    const auto idx = step % (footprint * num_words);
+    push(core == 0 ? InstructionType::WRITE : InstructionType::READ,
+         shared_address(idx / num_words, idx % num_words));
+  } break;
+  case WorkloadPattern::Migratory: {
+    const auto object = rng.below(footprint);
+    push(InstructionType::READ, shared_address(object));
+    push(InstructionType::WRITE, shared_address(object));
+  } break;
+  case WorkloadPattern::ReadMostly: {
+    push(is_write() ? InstructionType::WRITE : InstructionType::READ,
+         shared_address(rng.below(footprint), rng.below(num_words)));
+  } break;
+  case WorkloadPattern::FalseSharing: {
+    // Increment this core's own word of every line in turn
+    const auto line = static_cast<uint32_t>(step % footprint);
+    const auto word = static_cast<uint32_t>(core) % num_words;
+    push(InstructionType::READ, shared_address(line, word));
+    push(InstructionType::WRITE, shared_address(line, word));
+  } break;
+  case WorkloadPattern::Zipf: {
+    const auto line = static_cast<uint32_t>(zipf.sample(rng) - 1);
+    push(is_write() ? InstructionType::WRITE : InstructionType::READ,
+         shared_address(line, rng.below(num_words)));
+  } break;
+  case WorkloadPattern::LockPingPong: {
+    // Lock in line 0, the counter it protects in line 1
+    const auto num_spins = 1 + rng.below(3);
+    for (auto i = 0u; i < num_spins; i++) {
+      push(InstructionType::READ, shared_address(0));
+    }
+    push(InstructionType::WRITE, shared_address(0));
+    push(InstructionType::READ, shared_address(1));
+    push(InstructionType::WRITE, shared_address(1));
+    push(InstructionType::WRITE, shared_address(0));
+  } break;
+  case WorkloadPattern::Streaming: {
+    // Copy a private source array to a private destination array
+    const auto idx = step % (footprint * num_words);
+    push(InstructionType::READ, private_address(idx / num_words,
+                                                idx % num_words));
+    push(InstructionType::WRITE,
+         private_address(footprint + idx / num_words, idx % num_words));
+  } break;
+  }
+  step += 1;
+}
+
+auto WorkloadGenerator::next() -> Instruction {
+  if (next_pending == num_pending) {
+    next_pending = 0;
+    num_pending = 0;
+    if (config.max_compute_cycles > 0 &&
+        static_cast<int>(rng.below(100)) < config.compute_percent) {
+      return Instruction{
+          InstructionType::OTHER,
+          static_cast<int>(1 + rng.below(config.max_compute_cycles)),
+          std::nullopt};
+    }
+    generate_operation();
+  }
+  const auto &access = pending[next_pending++];
+  return Instruction{access.label, std::nullopt,
+                     static_cast<int>(access.address)};
+}
@@ -2,19 +2,20 @@
 
 auto WriteBuffer::is_empty() -> bool { return queue.empty(); }
 
-auto WriteBuffer::run_once() -> bool {
+auto WriteBuffer::run_once() -> std::optional<uint32_t> {
   if (queue.empty()) {
-    return false;
+    return std::nullopt;
   }
   // Write front of queue to memory
   queue.front() = std::make_tuple(std::get<0>(queue.front()),
                                   std::get<1>(queue.front()) - 1);
   if (std::get<1>(queue.front()) == 0) {
     // If write is done, remove from queue
+    const auto address = std::get<0>(queue.front());
     queue.erase(queue.begin());
-    return true;
+    return address;
   }
-  return false;
+  return std::nullopt;
 }
 
 auto WriteBuffer::add_to_queue(uint32_t address) -> bool {
@@ -37,3 +38,24 @@ auto WriteBuffer::remove_if_present(uint32_t address) -> bool {
   }
   return false;
 }
+
+void WriteBuffer::save(CheckpointWriter &writer) const {
+  writer.write(static_cast<uint64_t>(queue.size()));
+  for (const auto &[address, cycles_left] : queue) {
+    writer.write(address);
+    writer.write(cycles_left);
+  }
+}
+
+void WriteBuffer::restore(CheckpointReader &reader) {
+  auto num_writes = uint64_t{0};
+  reader.read(num_writes);
+  queue.clear();
+  for (auto i = uint64_t{0}; i < num_writes; i++) {
+    auto address = uint32_t{0};
+    auto cycles_left = 0;
+    reader.read(address);
+    reader.read(cycles_left);
+    queue.emplace_back(address, cycles_left);
+  }
+}
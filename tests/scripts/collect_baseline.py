@@ -0,0 +1,32 @@
+#!/usr/bin/env python3
+"""
+Merge the per-test results written by golden_test.py into a throughput
+baseline (a JSON map of test name to simulated cycles per second). The
+throughput tests write theirs to throughput_results/ in the build directory.
+"""
+
+import argparse
+import json
+from pathlib import Path
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Collect throughput baseline")
+    parser.add_argument("results_dir", help="Directory of golden_test.py results")
+    parser.add_argument("baseline", help="Baseline JSON file to write")
+    args = parser.parse_args()
+
+    baseline = {}
+    for path in sorted(Path(args.results_dir).glob("*.json")):
+        with open(path, "r", encoding="utf-8") as f:
+            result = json.load(f)
+        baseline[result["name"]] = result["cycles_per_second"]
+
+    with open(args.baseline, "w", encoding="utf-8") as f:
+        json.dump(baseline, f, indent=2, sort_keys=True)
+        f.write("\n")
+    print(f"Wrote {len(baseline)} entries to {args.baseline}")
+
+
+if __name__ == "__main__":
+    main()
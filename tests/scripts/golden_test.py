@@ -0,0 +1,314 @@
+#!/usr/bin/env python3
+"""
+Run the simulator on one benchmark directory and compare its STATISTICS block
+against a golden file. Also records the wall time and simulated cycles per
+second, and fails if the throughput drops too far below a baseline.
+
+The input may also be a synthetic one, e.g. synthetic:zipf, sized with
+--sim-args so that the simulation dominates the process start-up when the
+throughput is gated.
+
+With --checkpoint-at, the run saves a checkpoint on the way and a second run
+resumes from it; both must match the golden file. With --expect-threads, the
+simulator must also report running on that many threads, so that a threaded
+run cannot quietly fall back to the serial engine. With --sampling-args, a
+sampled run must estimate the golden execution cycles within its confidence
+interval and --sampling-tolerance.
+"""
+
+import argparse
+import difflib
+import json
+import shlex
+import subprocess
+import sys
+import tempfile
+import time
+from pathlib import Path
+
+STATS_BEGIN = "-------------STATISTICS"
+STATS_END = "---------------------------------------------"
+CYCLES_PREFIX = "Overall Execution Cycle:"
+THREADS_PREFIX = "Threads:"
+SAMPLED_BEGIN = "-------------SAMPLED ESTIMATES"
+
+
+def extract_statistics(output):
+    lines = output.splitlines(keepends=True)
+    try:
+        begin = next(i for i, x in enumerate(lines) if x.startswith(STATS_BEGIN))
+        end = next(
+            i for i in range(begin + 1, len(lines)) if lines[i].startswith(STATS_END)
+        )
+    except StopIteration:
+        return None
+    return "".join(lines[begin : end + 1])
+
+
+def simulator_command(args):
+    return [args.binary, args.protocol, args.input_dir] + shlex.split(args.sim_args)
+
+
+def run_simulator(command):
+    """
+    Returns the simulator's output and wall time, or None if it failed.
+    """
+    start = time.perf_counter()
+    completed = subprocess.run(command, capture_output=True, text=True, check=False)
+    wall_time = time.perf_counter() - start
+
+    if completed.returncode != 0:
+        print(completed.stdout)
+        print(completed.stderr, file=sys.stderr)
+        print(f"FAIL: simulator exited with {completed.returncode}")
+        return None
+    return completed.stdout, wall_time
+
+
+def extract_threads(output):
+    for line in output.splitlines():
+        if line.startswith(THREADS_PREFIX):
+            return int(line[len(THREADS_PREFIX) :])
+    return 1
+
+
+def compare_with_golden(statistics, golden_path):
+    golden = golden_path.read_text(encoding="utf-8")
+    if statistics == golden:
+        return True
+    print("FAIL: statistics differ from the golden file")
+    sys.stdout.writelines(
+        difflib.unified_diff(
+            golden.splitlines(keepends=True),
+            statistics.splitlines(keepends=True),
+            fromfile=str(golden_path),
+            tofile="actual",
+        )
+    )
+    return False
+
+
+def check_checkpoint_round_trip(args, golden_path):
+    """
+    Returns False unless a run checkpointed at --checkpoint-at and a run
+    restored from that checkpoint both produce the golden statistics.
+    """
+    with tempfile.TemporaryDirectory() as tmp_dir:
+        checkpoint = Path(tmp_dir) / "checkpoint.bin"
+        command = simulator_command(args)
+        result = run_simulator(
+            command
+            + ["--checkpoint-at", str(args.checkpoint_at)]
+            + ["--checkpoint-output", str(checkpoint)]
+        )
+        if result is None:
+            return False
+        if not checkpoint.exists():
+            print(result[0])
+            print(f"FAIL: no checkpoint was taken at cycle {args.checkpoint_at}")
+            return False
+        statistics = extract_statistics(result[0])
+        if statistics is None or not compare_with_golden(statistics, golden_path):
+            print("(while taking the checkpoint)")
+            return False
+
+        result = run_simulator(command + ["--restore-from", str(checkpoint)])
+        if result is None:
+            return False
+        statistics = extract_statistics(result[0])
+        if statistics is None or not compare_with_golden(statistics, golden_path):
+            print("(after restoring the checkpoint)")
+            return False
+    return True
+
+
+def extract_cycles(statistics):
+    for line in statistics.splitlines():
+        if line.startswith(CYCLES_PREFIX):
+            return int(line[len(CYCLES_PREFIX) :])
+    return None
+
+
+def extract_sampled_cycles(output):
+    """
+    Returns the sampled estimate of the execution cycles and the half-width of
+    its confidence interval, or None if the output has none.
+    """
+    lines = output.splitlines()
+    try:
+        begin = next(i for i, x in enumerate(lines) if x.startswith(SAMPLED_BEGIN))
+    except StopIteration:
+        return None
+    for line in lines[begin + 1 :]:
+        if line.startswith(CYCLES_PREFIX):
+            mean, half_width = line[len(CYCLES_PREFIX) :].split("+-")
+            return int(mean), float(half_width)
+    return None
+
+
+def check_sampling(args, golden_path):
+    """
+    Returns False unless a run with --sampling-args estimates the execution
+    cycles of the golden file within its 95% confidence interval, and within
+    --sampling-tolerance (a fraction) of them.
+    """
+    cycles = extract_cycles(golden_path.read_text(encoding="utf-8"))
+    result = run_simulator(simulator_command(args) + shlex.split(args.sampling_args))
+    if result is None:
+        return False
+    estimate = extract_sampled_cycles(result[0])
+    if estimate is None:
+        print("FAIL: no sampled estimates in the simulator output")
+        return False
+
+    mean, half_width = estimate
+    error = abs(mean - cycles)
+    print(
+        f"Sampled: {mean} +- {half_width:.0f} cycles, "
+        f"{error / cycles:.2%} from the full run's {cycles}"
+    )
+    if error > half_width:
+        print("FAIL: the full run is outside the confidence interval")
+        return False
+    if error > args.sampling_tolerance * cycles:
+        print(f"FAIL: the estimate is more than {args.sampling_tolerance:.0%} off")
+        return False
+    return True
+
+
+def check_throughput(name, cycles_per_second, baseline_path, tolerance):
+    """
+    Returns False if the throughput is more than `tolerance` (a fraction) below
+    the baseline entry for this test. Tests without a baseline entry pass.
+    """
+    if not baseline_path or not Path(baseline_path).exists():
+        return True
+
+    with open(baseline_path, "r", encoding="utf-8") as f:
+        baseline = json.load(f).get(name)
+    if baseline is None:
+        return True
+
+    threshold = baseline * (1.0 - tolerance)
+    if cycles_per_second < threshold:
+        print(
+            f"FAIL: throughput {cycles_per_second:.0f} cycles/s is below "
+            f"{threshold:.0f} (baseline {baseline:.0f}, tolerance {tolerance:.0%})"
+        )
+        return False
+    return True
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Golden statistics test")
+    parser.add_argument("binary", help="Path to the coherence executable")
+    parser.add_argument("protocol", help="Protocol to simulate")
+    parser.add_argument("input_dir", help="Benchmark directory")
+    parser.add_argument("golden", help="Golden STATISTICS block")
+    parser.add_argument(
+        "--sim-args",
+        default="",
+        help="Extra simulator arguments, e.g. --sim-args='--threads 4'",
+    )
+    parser.add_argument("--name", help="Test name, used as the baseline key")
+    parser.add_argument(
+        "--results", help="JSON file to write wall time and throughput to"
+    )
+    parser.add_argument("--baseline", help="JSON map of test name to cycles/s")
+    parser.add_argument(
+        "--tolerance",
+        type=float,
+        default=0.25,
+        help="Allowed fractional throughput drop below the baseline",
+    )
+    parser.add_argument(
+        "--update", action="store_true", help="Rewrite the golden file"
+    )
+    parser.add_argument(
+        "--checkpoint-at",
+        type=int,
+        help="Also check a checkpoint taken at this cycle and restored",
+    )
+    parser.add_argument(
+        "--sampling-args",
+        help="Also check the estimates of a run with these extra arguments, "
+        "e.g. --sampling-args='--sample-interval 5000'",
+    )
+    parser.add_argument(
+        "--sampling-tolerance",
+        type=float,
+        default=0.03,
+        help="Allowed fractional error of the sampled execution cycles",
+    )
+    parser.add_argument(
+        "--expect-threads",
+        type=int,
+        help="Number of threads the simulator must report running on",
+    )
+    args = parser.parse_args()
+    name = args.name or f"{args.protocol}_{Path(args.input_dir).name}"
+
+    result = run_simulator(simulator_command(args))
+    if result is None:
+        return 1
+    output, wall_time = result
+
+    if args.expect_threads is not None:
+        num_threads = extract_threads(output)
+        if num_threads != args.expect_threads:
+            print(f"FAIL: ran on {num_threads} threads, expected {args.expect_threads}")
+            return 1
+
+    statistics = extract_statistics(output)
+    if statistics is None:
+        print("FAIL: no STATISTICS block in the simulator output")
+        return 1
+
+    cycles = extract_cycles(statistics) or 0
+    cycles_per_second = cycles / wall_time if wall_time > 0 else 0.0
+    print(f"{name}: {cycles} cycles in {wall_time:.3f}s ({cycles_per_second:.0f} cycles/s)")
+
+    if args.results:
+        Path(args.results).parent.mkdir(parents=True, exist_ok=True)
+        with open(args.results, "w", encoding="utf-8") as f:
+            json.dump(
+                {
+                    "name": name,
+                    "cycles": cycles,
+                    "wall_time_s": wall_time,
+                    "cycles_per_second": cycles_per_second,
+                },
+                f,
+            )
+
+    golden_path = Path(args.golden)
+    if args.update:
+        golden_path.parent.mkdir(parents=True, exist_ok=True)
+        golden_path.write_text(statistics, encoding="utf-8")
+        print(f"Updated {golden_path}")
+        return 0
+
+    if not golden_path.exists():
+        print(f"FAIL: golden file {golden_path} does not exist (run with --update)")
+        return 1
+
+    if not compare_with_golden(statistics, golden_path):
+        return 1
+
+    if args.checkpoint_at is not None and not check_checkpoint_round_trip(
+        args, golden_path
+    ):
+        return 1
+
+    if args.sampling_args is not None and not check_sampling(args, golden_path):
+        return 1
+
+    if not check_throughput(name, cycles_per_second, args.baseline, args.tolerance):
+        return 1
+
+    print("PASS")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
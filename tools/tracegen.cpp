@@ -0,0 +1,154 @@
+#include "argparse/argparse.hpp"
+#include "trace.hpp"
+#include "workload.hpp"
+
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+auto tracegen_parser() -> argparse::ArgumentParser {
+  argparse::ArgumentParser program{"tracegen"};
+
+  std::stringstream ss;
+  ss << "Access pattern. One of: [";
+  for (auto it = WORKLOAD_PATTERNS.begin(); it != WORKLOAD_PATTERNS.end();
+       it++) {
+    ss << *it;
+    if (it != WORKLOAD_PATTERNS.end() - 1) {
+      ss << ", ";
+    }
+  }
+  ss << "]";
+
+  program.add_argument("pattern")
+      .help(ss.str())
+      .action([](const std::string &value) {
+        if (parse_workload_pattern(value)) {
+          return value;
+        }
+        throw std::runtime_error{"Invalid pattern: " + value};
+      });
+  program.add_argument("output_dir")
+      .help("Directory to write <name>_<core>.data to");
+  program.add_argument("--name")
+      .help("Benchmark name (default: the name of output_dir, as the "
+            "simulator expects)")
+      .default_value(std::string{""});
+  program.add_argument("--cores")
+      .help("Number of cores, up to " + std::to_string(MAX_WORKLOAD_CORES))
+      .default_value(NUM_CORES)
+      .scan<'i', int>();
+  program.add_argument("--length")
+      .help("Instructions per core")
+      .default_value(1000000)
+      .scan<'i', int>();
+  program.add_argument("--seed")
+      .help("Random seed")
+      .default_value(1)
+      .scan<'i', int>();
+  program.add_argument("--block_size")
+      .help("Block size (in bytes) the pattern is laid out for")
+      .default_value(32)
+      .scan<'i', int>();
+  program.add_argument("--footprint")
+      .help("Lines of shared (or, for streaming, per-core) data")
+      .default_value(1024)
+      .scan<'i', int>();
+  program.add_argument("--write-percent")
+      .help("Percentage of writes (read-mostly, zipf)")
+      .default_value(5)
+      .scan<'i', int>();
+  program.add_argument("--compute-percent")
+      .help("Percentage chance of a compute burst before each operation")
+      .default_value(10)
+      .scan<'i', int>();
+  program.add_argument("--max-compute-cycles")
+      .help("Maximum length of a compute burst")
+      .default_value(10)
+      .scan<'i', int>();
+  program.add_argument("--zipf-skew")
+      .help("Zipf exponent of the hot set")
+      .default_value(0.99)
+      .scan<'g', double>();
+  program.add_argument("--binary")
+      .help("Write binary traces instead of text")
+      .default_value(false)
+      .implicit_value(true);
+  return program;
+}
+
+/**
+ * @brief Name of the benchmark in `output_dir`: the simulator reads
+ * <dir>/<name>_<core>.data with <name> the directory's own name
+ *
+ */
+auto benchmark_name(const std::filesystem::path &output_dir) -> std::string {
+  auto dirpath = std::filesystem::absolute(output_dir).lexically_normal();
+  if (!dirpath.has_filename()) {
+    dirpath = dirpath.parent_path();
+  }
+  return dirpath.filename().string();
+}
+
+int main(int argc, char **argv) {
+  auto program = tracegen_parser();
+  try {
+    program.parse_args(argc, argv);
+  } catch (const std::runtime_error &err) {
+    std::cerr << err.what() << std::endl;
+    std::cerr << program;
+    std::exit(1);
+  }
+
+  const auto pattern_name = program.get<std::string>("pattern");
+  auto config = WorkloadConfig{};
+  config.pattern = parse_workload_pattern(pattern_name).value();
+  config.num_cores = program.get<int>("cores");
+  config.seed = static_cast<uint64_t>(program.get<int>("seed"));
+  config.block_size = program.get<int>("block_size");
+  config.footprint = program.get<int>("footprint");
+  config.write_percent = program.get<int>("write-percent");
+  config.compute_percent = program.get<int>("compute-percent");
+  config.max_compute_cycles = program.get<int>("max-compute-cycles");
+  config.zipf_skew = program.get<double>("zipf-skew");
+  const auto length = program.get<int>("length");
+  const auto is_binary = program.get<bool>("binary");
+
+  if (config.num_cores < 1 || config.num_cores > MAX_WORKLOAD_CORES) {
+    std::cerr << "--cores must be between 1 and " << MAX_WORKLOAD_CORES
+              << ", as each core's private region must fit in 32-bit "
+              << "addresses!" << std::endl;
+    std::exit(1);
+  }
+
+  const auto output_dir = std::filesystem::path{
+      program.get<std::string>("output_dir")};
+  auto name = program.get<std::string>("name");
+  if (name.empty()) {
+    name = benchmark_name(output_dir);
+  }
+  std::filesystem::create_directories(output_dir);
+
+  const auto start = std::chrono::steady_clock::now();
+  for (auto core = 0; core < config.num_cores; core++) {
+    auto generator = WorkloadGenerator{config, core};
+    auto writer =
+        TraceWriter{output_dir / (name + "_" + std::to_string(core) + ".data"),
+                    is_binary};
+    for (auto i = 0; i < length; i++) {
+      writer.write(generator.next());
+    }
+  }
+  const auto seconds = std::chrono::duration<double>(
+                           std::chrono::steady_clock::now() - start)
+                           .count();
+
+  const auto num_records = static_cast<double>(length) * config.num_cores;
+  std::cout << "Wrote " << config.num_cores << " x " << length << " "
+            << (is_binary ? "binary" : "text") << " records of " << name
+            << " to " << output_dir << " in " << seconds << "s ("
+            << num_records / seconds / 1e6 << "M records/s)" << std::endl;
+  return 0;
+}